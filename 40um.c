@@ -13,30 +13,106 @@
 #include <string.h>
 #include "bitpack.h"
 #include "filereader.h"
+#include "dedup.h"
+#include "codecache.h"
+#include "profiler.h"
+#include "umsched.h"
 #include <assert.h>
 #include <stdint.h>
 
 const unsigned HALT = 7;
 
+/* instructions between two checks for dedup scans and profile samples */
+#define POLL_INTERVAL (1u << 16)
+
 int main(int argc, char *argv[])
 {
    FILE *src;
-   if(argc != 2) {
-     fprintf(stderr, "Program called incorrectly, usage: ./um [input_file]");
+   int dedup = 0;
+   int async_io = 0;
+   const char *cache_dir = NULL;
+   unsigned profile_hz = 0;
+   const char *profile_path = NULL;
+   int port = 0;
+   while (argc > 2 && argv[1][0] == '-') {
+     if (strcmp(argv[1], "-d") == 0)
+       dedup = 1;
+     else if (strcmp(argv[1], "-a") == 0)
+       async_io = 1;
+     else if (strcmp(argv[1], "-c") == 0 && argc > 3) {
+       cache_dir = argv[2];
+       argv++;
+       argc--;
+     } else if (strcmp(argv[1], "-p") == 0 && argc > 3) {
+       char *end;
+       unsigned long hz = strtoul(argv[2], &end, 10);
+       if (end == argv[2] || *end != '\0' || hz == 0 || hz > PROFILE_MAX_HZ)
+         break;
+       profile_hz = hz;
+       argv++;
+       argc--;
+     } else if (strcmp(argv[1], "-o") == 0 && argc > 3) {
+       profile_path = argv[2];
+       argv++;
+       argc--;
+     } else if (strcmp(argv[1], "-l") == 0 && argc > 3) {
+       port = atoi(argv[2]);
+       argv++;
+       argc--;
+     } else
+       break;
+     argv++;
+     argc--;
+   }
+   if(argc != 2 || (profile_path != NULL && profile_hz == 0)
+      || (port != 0 && (async_io || profile_hz != 0))) {
+     fprintf(stderr, "Program called incorrectly, usage: ./um [-d] [-a] [-c cache_dir] [-p hz] [-o profile] [input_file] or ./um -l port [-d] [-c cache_dir] [input_file]");
      exit(EXIT_FAILURE);
    }
+   if (profile_path == NULL)
+     profile_path = "um.folded";
 
    um_memory memory = initialize_memory();
+   if (port != 0) {
+     src = fopen(argv[1], "r");
+     assert(src);
+     read_file(memory, src);
+     fclose(src);
+     memory->cache_dir = cache_dir;
+     sched_serve(memory, port, dedup);
+     free_memory(memory);
+     exit(EXIT_SUCCESS);
+   }
+   if (dedup)
+     memory->dedup = dedup_new(NULL);
+   umio io = NULL;
+   if (async_io) {
+     io = umio_new(0, 1);
+     memory->io = io;
+   }
    
    src = fopen(argv[1], "r");
    assert(src);
    read_file(memory, src);
    fclose(src);
+   memory->cache_dir = cache_dir;
+   code_load(memory);
+   if (profile_hz != 0)
+     profiler_start(memory, profile_hz, profile_path);
 
    uint32_t opcode = 0;
+   uint32_t executed = 0;
    while (opcode != HALT) {
      opcode = get_next_instruction(memory);
+     if (opcode == HALT || (++executed & (POLL_INTERVAL - 1)) != 0)
+       continue;
+     if (dedup && (executed & (DEDUP_INTERVAL - 1)) == 0)
+       dedup_scan(memory);
+     if (profile_hz != 0)
+       profiler_poll(memory);
    }
+   if (io != NULL)
+     umio_free(&io);
    
    exit(EXIT_SUCCESS);
 }
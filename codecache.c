@@ -0,0 +1,358 @@
+ /**************************************************************
+ *     Assignment: um
+ *     Authors: Isaac Hudis, Erena Inoue
+ *     Date: 10/19/26
+ *     File: codecache.c
+ *     Summary: Implementation of codecache module. A cache file is
+ *     named after the hash of segment 0 and holds a header, the
+ *     decoded instructions, the words they were decoded from, the
+ *     basic-block leaders and the most entered blocks with their
+ *     entry counts. The words must match segment 0 for the file to
+ *     be used, so a hash collision cannot run the wrong program.
+ *     Leaders and counts are loaded back with the file, and the file is rewritten whenever a run finds
+ *     a leader it did not list. Cache files are mapped
+ *     copy-on-write and replaced by rename, so a mapped image never
+ *     changes under a running UM.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "codecache.h"
+#include "filereader.h"
+
+struct cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t length;
+  uint64_t hash;
+  uint32_t nleaders;
+  uint32_t nhot;
+};
+
+static const char CACHE_MAGIC[8] = "UMCODE";
+static const unsigned HALT_OP = 7;
+static const unsigned LOAD_PROGRAM_OP = 12;
+
+static uint64_t hash_segment(struct um_segment *segment);
+static int is_leader(struct um_code *code, uint32_t index);
+static int map_cache(struct um_code *code, const uint32_t *words,
+                     const char *cache_dir);
+static void save_cache(struct um_code *code, const uint32_t *words,
+                       const char *cache_dir);
+static void cache_path(char *path, size_t size, const char *cache_dir,
+                       uint64_t hash);
+
+ /*
+ *  code_load
+ *
+ *  Function: Builds the decoded form of segment 0 and installs it as
+ *  mem->code, with mem->ops and mem->ops_length pointing at the decoded
+ *  instructions. If mem->cache_dir holds a cache file for the same
+ *  contents and emulator version it is mapped instead of decoding every
+ *  word, and its block leaders and hot block counts are loaded.
+ *  Input: um_memory mem (a NULL cache_dir disables the cache)
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL, if segment 0 is already
+ *  decoded or if allocating memory is unsuccessful.
+ */
+void code_load(um_memory mem)
+{
+    assert(mem && mem->code == NULL);
+    struct um_segment *seg_zero = &mem->segments[0];
+    struct um_code *code = calloc(1, sizeof(*code));
+    assert(code);
+    code->length = seg_zero->length;
+    code->hash = hash_segment(seg_zero);
+    code->leaders = calloc(code->length + 1, sizeof(uint8_t));
+    code->entries = calloc(code->length + 1, sizeof(uint32_t));
+    assert(code->leaders && code->entries);
+    if (mem->cache_dir == NULL
+        || !map_cache(code, seg_zero->words, mem->cache_dir)) {
+      code->changed = 1;
+      code->ops = malloc((code->length + 1) * sizeof(struct um_op));
+      assert(code->ops);
+      for (uint32_t i = 0; i < code->length; i++)
+        decode_instruction(seg_zero->words[i], &code->ops[i]);
+    }
+    mem->ops = code->ops;
+    mem->ops_length = code->length;
+    atomic_signal_fence(memory_order_seq_cst);
+    mem->code = code;
+}
+
+ /*
+ *  code_free
+ *
+ *  Function: Uninstalls the decoded segment 0, writes the cache file for
+ *  an image that was decoded in this run or that reached a leader its
+ *  cache file did not list, then frees the decoded form.
+ *  An image that was stored to is not saved: the cache file is keyed by
+ *  the contents segment 0 had when it was loaded, so it must hold the
+ *  decoding of exactly those contents, which segment 0 must still hold.
+ *  Input: um_memory mem (a NULL cache_dir disables the cache)
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or segment 0 is not
+ *  decoded. Failing to write the cache file is not an error. mem->code is
+ *  cleared before anything is freed, so a signal handler never sees a
+ *  freed decoding.
+ */
+void code_free(um_memory mem)
+{
+    assert(mem && mem->code);
+    struct um_code *c = mem->code;
+    mem->code = NULL;
+    mem->ops = NULL;
+    mem->ops_length = 0;
+    atomic_signal_fence(memory_order_seq_cst);
+    if (mem->cache_dir != NULL && c->changed && !c->patched)
+      save_cache(c, mem->segments[0].words, mem->cache_dir);
+    if (c->map != NULL)
+      munmap(c->map, c->map_size);
+    else
+      free(c->ops);
+    free(c->leaders);
+    free(c->entries);
+    free(c);
+}
+
+ /*
+ *  code_patch
+ *
+ *  Function: Keeps the decoded form in step with a store to segment 0,
+ *  and marks it as no longer matching its cache key.
+ *  Input: struct um_code *code, uint32_t index, uint32_t word
+ *  Output: None
+ *  Expectations: Will raise CRE if code is NULL or index is out of bounds.
+ */
+void code_patch(struct um_code *code, uint32_t index, uint32_t word)
+{
+    assert(code);
+    assert(index < code->length);
+    decode_instruction(word, &code->ops[index]);
+    code->patched = 1;
+}
+
+ /*
+ *  code_enter
+ *
+ *  Function: Records a jump to an instruction: it becomes a block leader
+ *  and its entry count grows, stopping at the largest count instead of
+ *  wrapping. Jumps outside of segment 0 are ignored.
+ *  Input: struct um_code *code, uint32_t index
+ *  Output: None
+ *  Expectations: Will raise CRE if code is NULL.
+ */
+void code_enter(struct um_code *code, uint32_t index)
+{
+    assert(code);
+    if (index >= code->length)
+      return ;
+    if (!code->leaders[index]) {
+      code->leaders[index] = 1;
+      code->changed = 1;
+    }
+    if (code->entries[index] != UINT32_MAX)
+      code->entries[index]++;
+}
+
+ /*
+ *  code_block
+ *
+ *  Function: Finds the basic block an instruction belongs to by walking
+ *  back to the nearest leader: the first instruction, an instruction after
+ *  halt or load_program, or one that a load_program has jumped to.
+ *  Input: struct um_code *code, uint32_t index
+ *  Output: index of the first instruction of the block
+ *  Expectations: Will raise CRE if code is NULL.
+ */
+uint32_t code_block(struct um_code *code, uint32_t index)
+{
+    assert(code);
+    if (index >= code->length)
+      return index;
+    while (!is_leader(code, index))
+      index--;
+    return index;
+}
+
+ /*
+ *  is_leader (Private Helper Function)
+ *
+ *  Function: Tells whether an instruction starts a basic block
+ *  Input: struct um_code *code, uint32_t index
+ *  Output: 1 if it does, 0 if not
+ *  Expectations: index must be in bounds
+ */
+static int is_leader(struct um_code *code, uint32_t index)
+{
+    if (index == 0 || code->leaders[index])
+      return 1;
+    uint32_t previous = code->ops[index - 1].opcode;
+    return previous == HALT_OP || previous == LOAD_PROGRAM_OP;
+}
+
+ /*
+ *  hash_segment (Private Helper Function)
+ *
+ *  Function: 64-bit FNV-1a hash of the cache version and the words of a
+ *  segment, used as the cache key
+ *  Input: struct um_segment *segment
+ *  Output: hash
+ *  Expectations: none
+ */
+static uint64_t hash_segment(struct um_segment *segment)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ CODE_CACHE_VERSION) * 1099511628211ull;
+    hash = (hash ^ sizeof(struct um_op)) * 1099511628211ull;
+    for (uint32_t i = 0; i < segment->length; i++) {
+      hash ^= segment->words[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void cache_path(char *path, size_t size, const char *cache_dir,
+                       uint64_t hash)
+{
+    snprintf(path, size, "%s/%016llx.umc", cache_dir,
+             (unsigned long long)hash);
+}
+
+ /*
+ *  map_cache (Private Helper Function)
+ *
+ *  Function: Maps the cache file for code->hash if there is a valid one
+ *  that was decoded from exactly the given words.
+ *  Input: struct um_code *code with length, hash, leaders and entries
+ *  set, const uint32_t *words of segment 0, const char *cache_dir
+ *  Output: 1 if code->ops now points into the mapped file, 0 if not
+ *  Expectations: none. Missing, stale or colliding files are ignored.
+ */
+static int map_cache(struct um_code *code, const uint32_t *words,
+                     const char *cache_dir)
+{
+    char path[4096];
+    cache_path(path, sizeof(path), cache_dir, code->hash);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct cache_header)) {
+      close(fd);
+      return 0;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return 0;
+
+    struct cache_header *header = map;
+    size_t expected = sizeof(*header)
+                      + (size_t)header->length * sizeof(struct um_op)
+                      + ((size_t)header->length + header->nleaders
+                         + 2 * (size_t)header->nhot) * sizeof(uint32_t);
+    struct um_op *ops = (struct um_op *)(header + 1);
+    uint32_t *source = (uint32_t *)(ops + code->length);
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || header->version != CODE_CACHE_VERSION
+        || header->length != code->length || header->hash != code->hash
+        || expected != (size_t)st.st_size
+        || memcmp(source, words, code->length * sizeof(uint32_t)) != 0) {
+      munmap(map, st.st_size);
+      return 0;
+    }
+    code->map = map;
+    code->map_size = st.st_size;
+    code->ops = ops;
+    uint32_t *leaders = source + code->length;
+    for (uint32_t i = 0; i < header->nleaders; i++) {
+      if (leaders[i] < code->length)
+        code->leaders[leaders[i]] = 1;
+    }
+    uint32_t *hot = leaders + header->nleaders;
+    for (uint32_t i = 0; i < header->nhot; i++) {
+      if (hot[2 * i] < code->length)
+        code->entries[hot[2 * i]] = hot[2 * i + 1];
+    }
+    return 1;
+}
+
+ /*
+ *  save_cache (Private Helper Function)
+ *
+ *  Function: Writes the cache file for an image, with the words it was
+ *  decoded from, the leaders found so far and the HOT_BLOCKS blocks
+ *  entered most often as (leader, count) pairs, counting the entries of
+ *  earlier runs loaded from the old file. The file is written under a
+ *  temporary name and renamed so readers never see a partial file.
+ *  Input: struct um_code *code, const uint32_t *words, const char
+ *  *cache_dir
+ *  Output: None
+ *  Expectations: none. I/O errors leave no cache file behind.
+ */
+static void save_cache(struct um_code *code, const uint32_t *words,
+                       const char *cache_dir)
+{
+    uint32_t nleaders = 0;
+    for (uint32_t i = 0; i < code->length; i++)
+      nleaders += is_leader(code, i);
+    uint32_t *leaders = malloc((nleaders + 1) * sizeof(uint32_t));
+    uint32_t hot[2 * HOT_BLOCKS];
+    uint32_t nhot = 0;
+    assert(leaders);
+    nleaders = 0;
+    for (uint32_t i = 0; i < code->length; i++) {
+      if (!is_leader(code, i))
+        continue;
+      leaders[nleaders++] = i;
+      uint32_t count = code->entries[i];
+      if (count == 0 || (nhot == HOT_BLOCKS && count <= hot[2 * nhot - 1]))
+        continue;
+      uint32_t slot = nhot < HOT_BLOCKS ? nhot++ : nhot - 1;
+      while (slot > 0 && hot[2 * slot - 1] < count) {
+        hot[2 * slot] = hot[2 * slot - 2];
+        hot[2 * slot + 1] = hot[2 * slot - 1];
+        slot--;
+      }
+      hot[2 * slot] = i;
+      hot[2 * slot + 1] = count;
+    }
+
+    struct cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CODE_CACHE_VERSION;
+    header.length = code->length;
+    header.hash = code->hash;
+    header.nleaders = nleaders;
+    header.nhot = nhot;
+
+    char path[4096];
+    char tmp[4096 + 32];
+    cache_path(path, sizeof(path), cache_dir, code->hash);
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (fp != NULL) {
+      int ok = fwrite(&header, sizeof(header), 1, fp) == 1
+               && fwrite(code->ops, sizeof(struct um_op), code->length, fp)
+                  == code->length
+               && fwrite(words, sizeof(uint32_t), code->length, fp)
+                  == code->length
+               && fwrite(leaders, sizeof(uint32_t), nleaders, fp) == nleaders
+               && fwrite(hot, 2 * sizeof(uint32_t), nhot, fp) == nhot;
+      if (fclose(fp) == 0 && ok)
+        rename(tmp, path);
+      else
+        remove(tmp);
+    }
+    free(leaders);
+}
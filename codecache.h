@@ -0,0 +1,64 @@
+/**************************************************************
+*     Assignment: um
+*     Authors: Isaac Hudis, Erena Inoue
+*     Date: 10/19/26
+*     File: codecache.h
+*     Summary: Interface of codecache module, which holds the
+*     decoded form of segment 0 and persists it on disk
+**************************************************************/
+
+#ifndef CODECACHE_INCLUDED
+#define CODECACHE_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segmem.h"
+
+/* bumped whenever the decoded format or the decoder changes */
+#define CODE_CACHE_VERSION 2
+
+/* number of most entered blocks recorded in the cache */
+#define HOT_BLOCKS 32
+
+/* one decoded instruction; value is only used by load_value */
+struct um_op {
+  uint32_t value;
+  uint8_t opcode;
+  uint8_t ra;
+  uint8_t rb;
+  uint8_t rc;
+};
+
+/* decoded segment 0; leaders flags the jump targets seen, entries
+   counts the jumps to each instruction (saturating), changed is set when
+   the cache file is missing or lacks a leader, and patched once ops no
+   longer match the hashed contents */
+struct um_code {
+  struct um_op *ops;
+  uint32_t length;
+  uint64_t hash;
+  uint8_t *leaders;
+  uint32_t *entries;
+  int changed;
+  int patched;
+  void *map;
+  size_t map_size;
+};
+
+/* decodes segment 0, or maps its cached decoding, and installs it */
+void code_load(um_memory mem);
+
+/* saves a new or changed, unpatched image to the cache and frees it */
+void code_free(um_memory mem);
+
+/* re-decodes one word of segment 0 after it was stored to */
+void code_patch(struct um_code *code, uint32_t index, uint32_t word);
+
+/* records a jump to index as the start of a block */
+void code_enter(struct um_code *code, uint32_t index);
+
+/* returns the first instruction of the block containing index */
+uint32_t code_block(struct um_code *code, uint32_t index);
+
+#endif
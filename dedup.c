@@ -0,0 +1,428 @@
+ /**************************************************************
+ *     Assignment: um
+ *     Authors: Isaac Hudis, Erena Inoue
+ *     Date: 10/19/26
+ *     File: dedup.c
+ *     Summary: Implementation of dedup module. Every segment that
+ *     has been hashed is owned by a dedup_buf record; segments
+ *     with equal contents point at the same record and the same
+ *     words until one of them is stored to.
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "dedup.h"
+#include "table.h"
+
+struct dedup_buf {
+    uint32_t *words;
+    uint32_t length;
+    uint32_t hash;
+    unsigned refs;
+};
+
+struct dedup_state {
+    struct dedup_state *totals;
+    Table_T index;
+    uint32_t buckets;
+    struct dedup_buf **owner;
+    uint32_t *dirty_epoch;
+    uint8_t *unmapped;
+    uint32_t capacity;
+    uint32_t epoch;
+    unsigned long scans;
+    unsigned long hashed;
+    unsigned long too_small;
+    unsigned long merged;
+    unsigned long cow_copies;
+    unsigned long words_shared;
+    unsigned long peak_words_shared;
+    unsigned long ums;
+};
+
+static int buf_cmp(const void *x, const void *y);
+static unsigned buf_hash(const void *key);
+static uint32_t hash_words(const uint32_t *words, uint32_t length);
+static void track(struct dedup_state *state, uint32_t segment);
+static int tracked(um_memory mem, uint32_t segment);
+static void resize_index(struct dedup_state *state, uint32_t segments);
+static void move_buf(const void *key, void **value, void *cl);
+static struct dedup_buf *adopt(um_memory mem, uint32_t segment);
+
+ /*
+ *  dedup_new
+ *
+ *  Function: Creates an empty dedup state with no segments hashed. When
+ *  totals is given, the statistics of the new state are added to it
+ *  when the state is freed, so that a server running many UMs reports
+ *  them once.
+ *  Input: struct dedup_state *totals (NULL to report on free)
+ *  Output: new dedup state
+ *  Expectations: Will raise CRE when allocating memory is unsuccessful.
+ */
+struct dedup_state *dedup_new(struct dedup_state *totals)
+{
+    struct dedup_state *state = calloc(1, sizeof(*state));
+    assert(state);
+    state->totals = totals;
+    state->buckets = 64;
+    state->index = Table_new(state->buckets, buf_cmp, buf_hash);
+    return state;
+}
+
+ /*
+ *  dedup_free
+ *
+ *  Function: Reports dedup statistics on stderr, or adds them to the
+ *  state's totals, and frees the state. Totals also count the UMs they
+ *  sum up and keep the largest peak of any of them. All segments must
+ *  have been released beforehand.
+ *  Input: struct dedup_state **state
+ *  Output: None
+ *  Expectations: Will raise CRE if state or *state is NULL, or if a
+ *  shared buffer is still referenced.
+ */
+void dedup_free(struct dedup_state **state)
+{
+    assert(state && *state);
+    struct dedup_state *s = *state;
+    struct dedup_state *t = s->totals;
+    if (t != NULL) {
+      t->ums++;
+      t->scans += s->scans;
+      t->hashed += s->hashed;
+      t->merged += s->merged;
+      t->too_small += s->too_small;
+      t->cow_copies += s->cow_copies;
+      if (s->peak_words_shared > t->peak_words_shared)
+        t->peak_words_shared = s->peak_words_shared;
+    } else {
+      if (s->ums != 0)
+        fprintf(stderr, "dedup: %lu UMs, ", s->ums);
+      else
+        fprintf(stderr, "dedup: ");
+      fprintf(stderr, "%lu scans, %lu segments hashed, %lu merged, "
+              "%lu skipped as shorter than %u words in the last scan, "
+              "%lu copy-on-write copies, peak %lu words shared\n",
+              s->scans, s->hashed, s->merged, s->too_small,
+              DEDUP_MIN_WORDS, s->cow_copies, s->peak_words_shared);
+    }
+    assert(Table_length(s->index) == 0);
+    Table_free(&s->index);
+    free(s->owner);
+    free(s->dirty_epoch);
+    free(s->unmapped);
+    free(s);
+    *state = NULL;
+}
+
+ /*
+ *  dedup_scan
+ *
+ *  Function: Starts a new epoch and hashes every mapped segment of at
+ *  least DEDUP_MIN_WORDS words that has not been stored to during the
+ *  whole previous epoch and is not already hashed. Shorter segments are
+ *  only counted: indexing one costs more than sharing it could save. A
+ *  segment whose contents match an already hashed one is freed and
+ *  replaced by the shared copy. The index is rebuilt with more
+ *  buckets first if the segment table has outgrown it.
+ *  Input: um_memory mem
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or dedup is disabled.
+ */
+void dedup_scan(um_memory mem)
+{
+    assert(mem && mem->dedup);
+    struct dedup_state *state = mem->dedup;
+    state->epoch++;
+    state->scans++;
+    resize_index(state, mem->segment_count);
+    state->too_small = 0;
+    for (uint32_t i = 0; i < mem->segment_count; i++) {
+      if (mem->segments[i].words == NULL)
+        continue;
+      if (mem->segments[i].length < DEDUP_MIN_WORDS) {
+        state->too_small++;
+        continue;
+      }
+      track(state, i);
+      if (state->owner[i] == NULL && !state->unmapped[i]
+          && state->dirty_epoch[i] + 1 < state->epoch)
+        adopt(mem, i);
+    }
+}
+
+ /*
+ *  dedup_before_store
+ *
+ *  Function: Records that the segment is written in the current epoch.
+ *  If the segment is shared it gets a private copy first; if it is the
+ *  only user of its hashed buffer, the buffer is dropped from the index
+ *  since its contents are about to change.
+ *  Input: um_memory mem, uint32_t segment
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or dedup is disabled, and
+ *  if allocating memory is unsuccessful.
+ */
+void dedup_before_store(um_memory mem, uint32_t segment)
+{
+    assert(mem && mem->dedup);
+    struct dedup_state *state = mem->dedup;
+    if (!tracked(mem, segment))
+      return ;
+    state->dirty_epoch[segment] = state->epoch;
+    state->unmapped[segment] = 0;
+    struct dedup_buf *buf = state->owner[segment];
+    if (buf == NULL)
+      return ;
+    state->owner[segment] = NULL;
+    if (buf->refs == 1) {
+      Table_remove(state->index, buf);
+      free(buf);
+      return ;
+    }
+    uint32_t *copy = malloc((buf->length ? buf->length : 1)
+                            * sizeof(uint32_t));
+    assert(copy);
+    memcpy(copy, buf->words, buf->length * sizeof(uint32_t));
+    mem->segments[segment].words = copy;
+    buf->refs--;
+    state->cow_copies++;
+    state->words_shared -= buf->length;
+}
+
+ /*
+ *  dedup_unmap
+ *
+ *  Function: Records that the segment was unmapped, so scans skip it
+ *  until map_segment reuses its identifier.
+ *  Input: um_memory mem, uint32_t segment
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or dedup is disabled.
+ */
+void dedup_unmap(um_memory mem, uint32_t segment)
+{
+    assert(mem && mem->dedup);
+    struct dedup_state *state = mem->dedup;
+    if (tracked(mem, segment))
+      state->unmapped[segment] = 1;
+}
+
+ /*
+ *  dedup_release
+ *
+ *  Function: Drops the segment's reference to its hashed buffer, if it
+ *  has one, before the segment's words are discarded.
+ *  Input: um_memory mem, uint32_t segment
+ *  Output: 1 if the segment's words are no longer used and must be freed
+ *  by the caller, 0 if other segments still share it.
+ *  Expectations: Will raise CRE if mem is NULL or dedup is disabled.
+ */
+int dedup_release(um_memory mem, uint32_t segment)
+{
+    assert(mem && mem->dedup);
+    struct dedup_state *state = mem->dedup;
+    if (!tracked(mem, segment))
+      return 1;
+    state->dirty_epoch[segment] = state->epoch;
+    struct dedup_buf *buf = state->owner[segment];
+    if (buf == NULL)
+      return 1;
+    state->owner[segment] = NULL;
+    if (--buf->refs > 0) {
+      state->words_shared -= buf->length;
+      return 0;
+    }
+    Table_remove(state->index, buf);
+    free(buf);
+    return 1;
+}
+
+ /*
+ *  dedup_share
+ *
+ *  Function: Hashes segment src if needed and installs its shared buffer
+ *  as segment dst instead of duplicating every word. The previous
+ *  contents of dst must already have been released.
+ *  Input: um_memory mem, uint32_t src, uint32_t dst
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or dedup is disabled.
+ */
+void dedup_share(um_memory mem, uint32_t src, uint32_t dst)
+{
+    assert(mem && mem->dedup);
+    struct dedup_state *state = mem->dedup;
+    track(state, dst);
+    struct dedup_buf *buf = adopt(mem, src);
+    buf->refs++;
+    state->owner[dst] = buf;
+    mem->segments[dst].words = buf->words;
+    mem->segments[dst].length = buf->length;
+    state->words_shared += buf->length;
+    if (state->words_shared > state->peak_words_shared)
+      state->peak_words_shared = state->words_shared;
+}
+
+ /*
+ *  adopt (Private Helper Function)
+ *
+ *  Function: Hashes the segment and looks its contents up in the index.
+ *  A match replaces the segment with the shared buffer; otherwise the
+ *  segment becomes the indexed copy of its contents.
+ *  Input: um_memory mem, uint32_t segment
+ *  Output: the buffer now owning the segment
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static struct dedup_buf *adopt(um_memory mem, uint32_t segment)
+{
+    struct dedup_state *state = mem->dedup;
+    track(state, segment);
+    if (state->owner[segment] != NULL)
+      return state->owner[segment];
+    struct dedup_buf probe;
+    probe.words = mem->segments[segment].words;
+    probe.length = mem->segments[segment].length;
+    probe.hash = hash_words(probe.words, probe.length);
+    state->hashed++;
+    struct dedup_buf *buf = Table_get(state->index, &probe);
+    if (buf != NULL) {
+      free(probe.words);
+      mem->segments[segment].words = buf->words;
+      buf->refs++;
+      state->merged++;
+      state->words_shared += buf->length;
+      if (state->words_shared > state->peak_words_shared)
+        state->peak_words_shared = state->words_shared;
+    } else {
+      buf = malloc(sizeof(*buf));
+      assert(buf);
+      *buf = probe;
+      buf->refs = 1;
+      Table_put(state->index, buf, buf);
+    }
+    state->owner[segment] = buf;
+    return buf;
+}
+
+ /*
+ *  track (Private Helper Function)
+ *
+ *  Function: Grows the per-segment arrays so that segment is in bounds.
+ *  New segments start out clean in epoch 0.
+ *  Input: struct dedup_state *state, uint32_t segment
+ *  Output: None
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static void track(struct dedup_state *state, uint32_t segment)
+{
+    if (segment < state->capacity)
+      return ;
+    uint32_t capacity = state->capacity ? state->capacity : 64;
+    while (capacity <= segment)
+      capacity *= 2;
+    state->owner = realloc(state->owner, capacity * sizeof(*state->owner));
+    state->dirty_epoch = realloc(state->dirty_epoch,
+                                 capacity * sizeof(*state->dirty_epoch));
+    state->unmapped = realloc(state->unmapped,
+                              capacity * sizeof(*state->unmapped));
+    assert(state->owner && state->dirty_epoch && state->unmapped);
+    for (uint32_t i = state->capacity; i < capacity; i++) {
+      state->owner[i] = NULL;
+      state->dirty_epoch[i] = 0;
+      state->unmapped[i] = 0;
+    }
+    state->capacity = capacity;
+}
+
+ /*
+ *  tracked (Private Helper Function)
+ *
+ *  Function: Decides whether the per-segment arrays need to cover the
+ *  segment. Scans never hash segments shorter than DEDUP_MIN_WORDS, so
+ *  those are left out unless the arrays already reach them, which keeps
+ *  programs that map many small segments from paying for the arrays.
+ *  Input: um_memory mem, uint32_t segment
+ *  Output: 1 if the segment is in bounds of the arrays, 0 otherwise
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static int tracked(um_memory mem, uint32_t segment)
+{
+    struct dedup_state *state = mem->dedup;
+    if (segment < state->capacity)
+      return 1;
+    if (mem->segments[segment].length < DEDUP_MIN_WORDS)
+      return 0;
+    track(state, segment);
+    return 1;
+}
+
+ /*
+ *  resize_index (Private Helper Function)
+ *
+ *  Function: Table_T never grows its bucket array, so once there are
+ *  more segments than buckets the index is moved into a new table sized
+ *  for one bucket per segment, keeping chains short.
+ *  Input: struct dedup_state *state, uint32_t segments
+ *  Output: None
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static void resize_index(struct dedup_state *state, uint32_t segments)
+{
+    if (segments <= state->buckets)
+      return ;
+    while (state->buckets < segments)
+      state->buckets *= 2;
+    Table_T index = Table_new(state->buckets, buf_cmp, buf_hash);
+    Table_map(state->index, move_buf, index);
+    Table_free(&state->index);
+    state->index = index;
+}
+
+static void move_buf(const void *key, void **value, void *cl)
+{
+    Table_put((Table_T)cl, key, *value);
+}
+
+ /*
+ *  hash_words (Private Helper Function)
+ *
+ *  Function: FNV-1a hash of the words of a segment
+ *  Input: const uint32_t *words, uint32_t length
+ *  Output: 32-bit hash
+ *  Expectations: none
+ */
+static uint32_t hash_words(const uint32_t *words, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+      hash ^= words[i];
+      hash *= 16777619u;
+    }
+    return hash ^ length;
+}
+
+ /*
+ *  buf_cmp / buf_hash (Private Helper Functions)
+ *
+ *  Function: Table_T callbacks keying dedup_buf records by contents
+ *  Input: dedup_buf records
+ *  Output: 0 if both buffers hold the same words / the cached hash
+ *  Expectations: none
+ */
+static int buf_cmp(const void *x, const void *y)
+{
+    const struct dedup_buf *a = x;
+    const struct dedup_buf *b = y;
+    if (a->hash != b->hash || a->length != b->length)
+      return 1;
+    if (a->words == b->words)
+      return 0;
+    return memcmp(a->words, b->words, a->length * sizeof(uint32_t)) != 0;
+}
+
+static unsigned buf_hash(const void *key)
+{
+    return ((const struct dedup_buf *)key)->hash;
+}
@@ -0,0 +1,46 @@
+/**************************************************************
+*     Assignment: um
+*     Authors: Isaac Hudis, Erena Inoue
+*     Date: 10/19/26
+*     File: dedup.h
+*     Summary: Interface of dedup module, which merges segments
+*     with identical contents into one shared copy-on-write
+*     buffer
+**************************************************************/
+
+#ifndef DEDUP_INCLUDED
+#define DEDUP_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segmem.h"
+
+/* number of instructions between two dedup scans (a power of two) */
+#define DEDUP_INTERVAL (1u << 22)
+
+/* segments shorter than this are never hashed by a scan: the index
+   entry for a segment costs about as much as 20 words */
+#define DEDUP_MIN_WORDS 256u
+
+/* a state whose statistics are added to totals, if not NULL, when it is
+   freed instead of being reported; totals reports the sum of all */
+struct dedup_state *dedup_new(struct dedup_state *totals);
+void dedup_free(struct dedup_state **state);
+
+/* hashes segments that stayed read-only and merges identical ones */
+void dedup_scan(um_memory mem);
+
+/* marks a segment as written, unsharing it first if it is shared */
+void dedup_before_store(um_memory mem, uint32_t segment);
+
+/* marks an unmapped segment so scans skip it until it is reused */
+void dedup_unmap(um_memory mem, uint32_t segment);
+
+/* drops a segment's reference; returns 1 if the caller must free it */
+int dedup_release(um_memory mem, uint32_t segment);
+
+/* makes segment dst share the contents of segment src */
+void dedup_share(um_memory mem, uint32_t src, uint32_t dst);
+
+#endif
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "filereader.h"
+#include "umsched.h"
 
 const int BYTE = 8;
 const int OPCODE = 4;
@@ -17,9 +18,7 @@ const unsigned LOAD_VALUE = 13;
 const int REGISTER_WIDTH = 3;
 const int LV_LSB = 25;
 
-static uint32_t decode_instruction(um_memory mem, uint32_t *instruction);
-static void call_instruction(uint32_t opcode, uint32_t local_instruc, 
-                             um_memory mem);
+static uint32_t call_instruction(struct um_op *op, um_memory mem);
 
  /* 
  *  read_file
@@ -34,13 +33,21 @@ static void call_instruction(uint32_t opcode, uint32_t local_instruc,
 void read_file(um_memory mem, FILE *fp)
 {
     assert(fp);
-    Seq_T seg_zero = Seq_get(mem->identifiers, 0);
+    struct um_segment *seg_zero = &mem->segments[0];
+    uint32_t capacity = 1024;
+    seg_zero->words = malloc(capacity * sizeof(uint32_t));
+    seg_zero->length = 0;
+    assert(seg_zero->words);
     int c;
     uint32_t temp = 0;
     c = getc(fp);
     while (feof(fp) == 0 && c != EOF) {
-        uint32_t *word = malloc(sizeof(uint32_t));
-        assert(word);
+        if (seg_zero->length == capacity) {
+          capacity *= 2;
+          seg_zero->words = realloc(seg_zero->words,
+                                    capacity * sizeof(uint32_t));
+          assert(seg_zero->words);
+        }
         for (int i = 0; i < 4; i++) {
           if (c == EOF)
             break;
@@ -55,79 +62,79 @@ void read_file(um_memory mem, FILE *fp)
         
           c = getc(fp);
         }  
-        *word = temp;
-        Seq_addhi(seg_zero, word);
+        seg_zero->words[seg_zero->length++] = temp;
     }
 }
 
  /* 
  *  get_next_instruction
  * 
- *  Function: Gets the next instruction word to call from identifers sequence
- *  and calls decode_function which will call a coresponding instruction
- *  function.
+ *  Function: Gets the next decoded instruction of segment 0 and calls
+ *  call_instruction which will call a coresponding instruction function.
  *  Input: um_memory mem
- *  Output: returns opcode in uint32_t format
- *  Expections: Will rasie a CRE if mem is NULL.
+ *  Output: returns opcode in uint32_t format, or INPUT_BLOCKED if the UM
+ *  runs in a session that has no input ready, in which case nothing was
+ *  executed.
+ *  Expections: Will rasie a CRE if mem is NULL, if the program counter is
+ *  outside of segment 0 and if the opcode is out of bounds.
  */
 uint32_t get_next_instruction(um_memory mem)
 {
     assert(mem);
-    Seq_T seg = Seq_get(mem->identifiers, mem->program_counter_seg);
-    uint32_t *next_instruction = Seq_get(seg, mem->program_counter_index);
-    return decode_instruction(mem, next_instruction);
+    assert(mem->program_counter_index < mem->ops_length);
+    struct um_op *next_instruction = &mem->ops[mem->program_counter_index];
+    assert(next_instruction->opcode <= 13);
+    return call_instruction(next_instruction, mem);
 }
 
  /* 
- *  decode_function (Private Helper Function)
+ *  decode_instruction
  * 
- *  Function: Unpack the instruction word obtained from get_next_instruction
- *  function and gets the opcode needed. If the opcode turned out to be 13,
- *  or LOAD_VALUE, then unpack the insturction word in this function and
- *  calls the load_value instruction function. Else, call call_instruction
- *  function for all other opcode. 
- *  Input: um_memory mem, uint32_t *instruction
- *  Output: returns opcode in uint32_t format
- *  Expections: Will rasie a CRE if mem and/or instruction are NULL. Also
- *  raises a CRE if the obtained opcode is out of bounds. 
+ *  Function: Unpack an instruction word into its opcode and registers. If
+ *  the opcode turned out to be 13, or LOAD_VALUE, then ra and value are
+ *  unpacked instead. Words that are never executed may hold any opcode, so
+ *  the opcode is only checked when the instruction is called.
+ *  Input: uint32_t instruction, struct um_op *op
+ *  Output: None, op is filled in
+ *  Expections: Will rasie a CRE if op is NULL. 
  */
-static uint32_t decode_instruction(um_memory mem, uint32_t *instruction)
+void decode_instruction(uint32_t instruction, struct um_op *op)
 {
-    assert(mem);
-    assert(instruction);
-    uint32_t local_instruc = *instruction;
-    uint32_t opcode = Bitpack_getu(local_instruc, OPCODE, OPCODE_LSB);
-    assert(opcode <= 13);
-    if (opcode == LOAD_VALUE) {
-      uint32_t ra = Bitpack_getu(local_instruc, REGISTER_WIDTH, LV_LSB);
-      uint32_t value = Bitpack_getu(local_instruc, LV_LSB, 0);
-      load_value(mem, ra, value);
-      mem->program_counter_index++;
+    assert(op);
+    op->opcode = Bitpack_getu(instruction, OPCODE, OPCODE_LSB);
+    if (op->opcode == LOAD_VALUE) {
+      op->ra = Bitpack_getu(instruction, REGISTER_WIDTH, LV_LSB);
+      op->rb = 0;
+      op->rc = 0;
+      op->value = Bitpack_getu(instruction, LV_LSB, 0);
     } else {
-      call_instruction(opcode, local_instruc, mem);
+      op->ra = Bitpack_getu(instruction, REGISTER_WIDTH, 6);
+      op->rb = Bitpack_getu(instruction, REGISTER_WIDTH, 3);
+      op->rc = Bitpack_getu(instruction, REGISTER_WIDTH, 0);
+      op->value = 0;
     }
-    return opcode;
 }
 
 /* 
 *  call_instruction (Private Helper Function)
 *
-*  Function: Unpack the local_instruc word ot obtain the necessary 
-*  registers to call instruction functions with. Then, calls an 
-*  instruction function that corresponds with the specified opcode.
-*  Finally, it increments the program counter, unless it is callling
-*  halt or load_program.
-*  Input: uint32_t opcode, uint32_t local_instruc, um_memory mem
-*  Output: None
+*  Function: Calls an instruction function that corresponds with the 
+*  opcode of the decoded instruction, with its registers. Finally, it 
+*  increments the program counter, unless it is callling halt or 
+*  load_program.
+*  The input instruction is not called, and the program counter is not
+*  incremented, when the UM's session has no input ready.
+*  Input: struct um_op *op, um_memory mem
+*  Output: the opcode, or INPUT_BLOCKED
 *  Expections: Will rasie a CRE if mem is NULL. 
 */
-static void call_instruction(uint32_t opcode, uint32_t local_instruc, 
-                             um_memory mem)
+static uint32_t call_instruction(struct um_op *op, um_memory mem)
 {
     assert(mem);
-    uint32_t ra = Bitpack_getu(local_instruc, REGISTER_WIDTH, 6);
-    uint32_t rb = Bitpack_getu(local_instruc, REGISTER_WIDTH, 3);
-    uint32_t rc = Bitpack_getu(local_instruc, REGISTER_WIDTH, 0);
+    uint32_t opcode = op->opcode;
+    uint32_t ra = op->ra;
+    uint32_t rb = op->rb;
+    uint32_t rc = op->rc;
     if (opcode == 0) 
       conditional_move(ra, rb, rc, mem);
     else if (opcode == 1)
@@ -144,18 +151,22 @@ static void call_instruction(uint32_t opcode, uint32_t local_instruc,
       bit_nand(ra, rb, rc, mem);
     else if (opcode == 7) {
       halt(mem);
-      return ;
+      return opcode;
     } else if (opcode == 8)
       map(mem, rb, rc);
     else if (opcode == 9)
       unmap(mem, rc);
     else if (opcode == 10)
       output(mem, rc);
-    else if (opcode == 11) 
+    else if (opcode == 11) {
+      if (mem->session != NULL && !session_input_ready(mem->session))
+        return INPUT_BLOCKED;
       input(mem, rc);
-    else if (opcode == 12) {
+    } else if (opcode == 12) {
       load_program(mem, rb, rc);
-      return ;
-    }
+      return opcode;
+    } else if (opcode == LOAD_VALUE)
+      load_value(mem, ra, op->value);
     mem->program_counter_index++;
+    return opcode;
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "seq.h"
 #include "stack.h"
 #include "instructions.h"
+#include "codecache.h"
 #include "bitpack.h"
 #include <assert.h>
 #include <stdint.h>
@@ -18,5 +19,11 @@
 /* initial file reading */
 void read_file(um_memory mem, FILE *fp);
 
-/* obtains next instruction for decode and execute */
-uint32_t get_next_instruction(um_memory mem);
\ No newline at end of file
+/* returned instead of an opcode when input would have to wait */
+#define INPUT_BLOCKED 14
+
+/* executes the next decoded instruction of segment 0 */
+uint32_t get_next_instruction(um_memory mem);
+
+/* unpacks one instruction word */
+void decode_instruction(uint32_t instruction, struct um_op *op);
\ No newline at end of file
@@ -9,8 +9,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
-#include "seq.h"
+#include <string.h>
 #include "instructions.h"
+#include "dedup.h"
+#include "codecache.h"
+#include "profiler.h"
+#include "umsched.h"
 #include "stack.h"
 
 /*
@@ -52,9 +56,8 @@ void segment_load(uint32_t ra, uint32_t rb, uint32_t rc, um_memory mem)
     assert(ra <= 7);
     assert(rb <= 7);
     assert(rc <= 7);
-    Seq_T segment = Seq_get(mem->identifiers, mem->registers[rb]);
-    uint32_t value_at_index = *(uint32_t *)Seq_get(segment, mem->registers[rc]);
-    mem->registers[ra] = value_at_index;
+    struct um_segment *segment = &mem->segments[mem->registers[rb]];
+    mem->registers[ra] = segment->words[mem->registers[rc]];
 }
 
 /*
@@ -68,7 +71,8 @@ void segment_load(uint32_t ra, uint32_t rb, uint32_t rc, um_memory mem)
  *  as well as register values that are outside the correct bounds of 0-7. 
  *  Requesting an unmapped segment or an index that is outside of the bounds
  *  of a segment will result in failure and undefined behaviour, similar to 
- *  segmented load.
+ *  segmented load. A segment shared through dedup is copied before it is
+ *  written, and a store to segment 0 is decoded again for execution.
  */
 void segment_store(uint32_t ra, uint32_t rb, uint32_t rc, um_memory mem)
 {
@@ -77,14 +81,12 @@ void segment_store(uint32_t ra, uint32_t rb, uint32_t rc, um_memory mem)
     assert(rb <= 7);
     assert(rc <= 7);
     uint32_t value_to_add = mem->registers[rc];
-    uint32_t *ptr = malloc(sizeof(uint32_t));
-    assert(ptr);
-    *ptr = value_to_add;
-    Seq_T segment = Seq_get(mem->identifiers, mem->registers[ra]);
-    uint32_t *to_free = Seq_get(segment, mem->registers[rb]);
-    free(to_free);
-    Seq_put(segment, mem->registers[rb], ptr);
-  
+    if (mem->dedup != NULL)
+      dedup_before_store(mem, mem->registers[ra]);
+    struct um_segment *segment = &mem->segments[mem->registers[ra]];
+    segment->words[mem->registers[rb]] = value_to_add;
+    if (mem->registers[ra] == 0)
+      code_patch(mem->code, mem->registers[rb], value_to_add);
 }
 
 /*
@@ -227,7 +229,9 @@ void unmap(um_memory mem, uint32_t rc)
  *  output
  *
  *  Function: this implements the output instruction for UM. It prints the 
- *  value in $r[rc] to the I/O device.
+ *  value in $r[rc] to the I/O device, or queues it for the I/O thread
+ *  when asynchronous I/O is enabled, or for the UM's connection when it
+ *  runs in a scheduler session.
  *  Input: register value rc, as well as um_memory struct mem.
  *  Output: none
  *  Expections: it is a checked runtime error to pass in a null um_memory 
@@ -240,7 +244,12 @@ void output(um_memory mem, uint32_t rc)
     assert(mem->registers[rc] < 256);
     assert(mem);
     assert(rc <= 7);
-    putchar(mem->registers[rc]); 
+    if (mem->session != NULL)
+      session_putc(mem->session, mem->registers[rc]);
+    else if (mem->io != NULL)
+      umio_put(mem->io, mem->registers[rc]);
+    else
+      putchar(mem->registers[rc]); 
 }
 
 /*
@@ -249,7 +258,12 @@ void output(um_memory mem, uint32_t rc)
  *  Function: this implements the input instruction for the UM. It reads one 
  *  character from the I/O device and checks if it is the end of stream
  *  indicator, in which case it places the bit value of all 1s in $r[rc] and
- *  ends. Otherwise, it stores the character read in in $r[rc].
+ *  ends. Otherwise, it stores the character read in in $r[rc]. When
+ *  asynchronous I/O is enabled the character comes from the input ring,
+ *  and in a scheduler session from the session's input queue, which the
+ *  scheduler has checked is not empty. A profiled UM waits for input in
+ *  profiler_wait_input, reading stdin through profiler_getc, so that it
+ *  still answers SIGUSR1 while blocked.
  *  Input: register value rc, as well as um_memory struct mem.
  *  Output: it is a checked runtime error to pass in a null um_memory struct,
  *  as well as register values that are outside the correct bounds of 0-7. It
@@ -260,7 +274,19 @@ void input(um_memory mem, uint32_t rc)
 {
     assert(mem);
     assert(rc <= 7);
-    int input = getchar();
+    if (mem->session != NULL) {
+      mem->registers[rc] = session_getc(mem->session);
+      return ;
+    }
+    if (mem->io != NULL) {
+      int fd;
+      while (mem->profiler != NULL && !umio_input_ready(mem->io)
+             && (fd = umio_input_fd(mem->io)) >= 0)
+        profiler_wait_input(mem, fd);
+      mem->registers[rc] = umio_get(mem->io);
+      return ;
+    }
+    int input = mem->profiler != NULL ? profiler_getc(mem) : getchar();
     if (input == ~0) {
       uint32_t end_value = ~0;
       mem->registers[rc] = end_value;
@@ -282,7 +308,10 @@ void input(um_memory mem, uint32_t rc)
  *  Expections: it is a checked runtime error to pass in a null um_memory 
  *  struct, as well as register values that are outside the correct bounds of 
  *  0-7. If value in $r[rb] is 0, this function will be very quick as it will 
- *  only update the program counter and then end. 
+ *  only update the program counter and then end. With dedup enabled the new
+ *  segment 0 shares the words of $m[$r[rb]] until either one is written.
+ *  The new segment 0 is decoded, or found in the code cache, before the
+ *  jump, and every jump target is counted as a basic-block entry.
  */
 void load_program(um_memory mem, uint32_t rb, uint32_t rc)
 {
@@ -290,28 +319,28 @@ void load_program(um_memory mem, uint32_t rb, uint32_t rc)
     assert(rb <= 7);
     assert(rc <= 7);
     if (mem->registers[rb] == 0) {
-      mem->program_counter_seg = 0;
       mem->program_counter_index = mem->registers[rc];
+      code_enter(mem->code, mem->program_counter_index);
       return ;
+    }
+    if (mem->profiler != NULL)
+      profiler_poll(mem);
+    code_free(mem);
+    release_segment(mem, 0);
+    if (mem->dedup != NULL) {
+      dedup_share(mem, mem->registers[rb], 0);
     } else {
-      Seq_T seq_zero = Seq_get(mem->identifiers, 0);
-      for (int i = 0; i < Seq_length(seq_zero); i++) {
-        uint32_t *to_free = Seq_get(seq_zero, i);
-        free(to_free);
-      }
-      Seq_free(&seq_zero);
-      Seq_T new_program = Seq_get(mem->identifiers, mem->registers[rb]);
-      Seq_T duplicate = Seq_new(Seq_length(new_program));
-      for (int i = 0; i < Seq_length(new_program); i++) {
-        uint32_t *temp = malloc(sizeof(uint32_t));
-        assert(temp);
-        *temp = *(uint32_t *)Seq_get(new_program, i);
-        Seq_addhi(duplicate, (void *)temp);
-      }
-      Seq_put(mem->identifiers, 0, duplicate);
-      mem->program_counter_seg = 0;
-      mem->program_counter_index = mem->registers[rc];
-  }
+      struct um_segment *new_program = &mem->segments[mem->registers[rb]];
+      uint32_t length = new_program->length;
+      uint32_t *duplicate = malloc((length ? length : 1) * sizeof(uint32_t));
+      assert(duplicate);
+      memcpy(duplicate, new_program->words, length * sizeof(uint32_t));
+      mem->segments[0].words = duplicate;
+      mem->segments[0].length = length;
+    }
+    code_load(mem);
+    mem->program_counter_index = mem->registers[rc];
+    code_enter(mem->code, mem->program_counter_index);
 }
 
 
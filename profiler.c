@@ -0,0 +1,371 @@
+ /**************************************************************
+ *     Assignment: um
+ *     Authors: Isaac Hudis, Erena Inoue
+ *     Date: 10/19/26
+ *     File: profiler.c
+ *     Summary: Implementation of profiler module. The SIGPROF
+ *     handler only copies the program counter, its opcode and the
+ *     hash of segment 0 into a lock-free ring. The UM drains the
+ *     ring from profiler_poll, which is where samples are grouped
+ *     by basic block and counted.
+ **************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "profiler.h"
+#include "codecache.h"
+#include "table.h"
+
+#define SAMPLE_RING (1u << 14)
+#define INPUT_BUFFER 4096
+#define UNKNOWN_OP 14
+
+struct sample {
+    uint64_t image;
+    uint32_t pc;
+    uint32_t opcode;
+};
+
+struct profile_entry {
+    uint64_t image;
+    uint32_t block;
+    uint32_t opcode;
+    unsigned long count;
+};
+
+struct profiler {
+    struct sample ring[SAMPLE_RING];
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_ulong dropped;
+    Table_T counts;
+    const char *path;
+    struct sigaction old_prof;
+    struct sigaction old_usr1;
+    unsigned char input[INPUT_BUFFER];
+    size_t input_pos;
+    size_t input_length;
+    int input_eof;
+};
+
+static const char *OP_NAMES[] = {
+    "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+    "map", "unmap", "out", "in", "loadprog", "loadval", "unknown"
+};
+
+static um_memory volatile profiled = NULL;
+static volatile sig_atomic_t dump_requested = 0;
+
+static void on_sigprof(int signo);
+static void on_sigusr1(int signo);
+static void drain(um_memory mem);
+static void dump(struct profiler *prof);
+static void write_entry(const void *key, void **value, void *cl);
+static void free_entry(const void *key, void **value, void *cl);
+static int entry_cmp(const void *x, const void *y);
+static unsigned entry_hash(const void *key);
+
+ /*
+ *  profiler_start
+ *
+ *  Function: Installs the SIGPROF and SIGUSR1 handlers and arms a CPU
+ *  time interval timer firing hz times per second. Only one UM can be
+ *  profiled at a time.
+ *  Input: um_memory mem, unsigned hz, const char *path of the profile
+ *  Output: the new profiler, also stored in mem->profiler
+ *  Expectations: Will raise CRE if mem or path is NULL, if hz is 0 or
+ *  above one million, if a UM is already profiled and if allocating
+ *  memory or arming the timer is unsuccessful.
+ */
+struct profiler *profiler_start(um_memory mem, unsigned hz, const char *path)
+{
+    assert(mem && path);
+    assert(hz > 0 && hz <= PROFILE_MAX_HZ);
+    assert(profiled == NULL);
+    struct profiler *prof = malloc(sizeof(*prof));
+    assert(prof);
+    atomic_init(&prof->head, 0);
+    atomic_init(&prof->tail, 0);
+    atomic_init(&prof->dropped, 0);
+    prof->counts = Table_new(1024, entry_cmp, entry_hash);
+    prof->path = path;
+    prof->input_pos = prof->input_length = 0;
+    prof->input_eof = 0;
+    mem->profiler = prof;
+    profiled = mem;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = on_sigprof;
+    sigaction(SIGPROF, &sa, &prof->old_prof);
+    sa.sa_handler = on_sigusr1;
+    sigaction(SIGUSR1, &sa, &prof->old_usr1);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 1000000 / hz / 1000000;
+    timer.it_interval.tv_usec = 1000000 / hz % 1000000;
+    timer.it_value = timer.it_interval;
+    int rc = setitimer(ITIMER_PROF, &timer, NULL);
+    assert(rc == 0);
+    return prof;
+}
+
+ /*
+ *  profiler_stop
+ *
+ *  Function: Disarms the timer, restores the previous handlers, writes
+ *  the final profile and frees the profiler. Called before segment 0's
+ *  decoding is freed so the last samples can still be grouped.
+ *  Input: um_memory mem
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or is not profiled.
+ */
+void profiler_stop(um_memory mem)
+{
+    assert(mem && mem->profiler);
+    struct profiler *prof = mem->profiler;
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    sigaction(SIGPROF, &prof->old_prof, NULL);
+    sigaction(SIGUSR1, &prof->old_usr1, NULL);
+    profiled = NULL;
+
+    drain(mem);
+    dump(prof);
+    Table_map(prof->counts, free_entry, NULL);
+    Table_free(&prof->counts);
+    free(prof);
+    mem->profiler = NULL;
+}
+
+ /*
+ *  profiler_poll
+ *
+ *  Function: Counts the samples taken since the last call, and writes
+ *  the profile so far if SIGUSR1 was received. Must also be called
+ *  before segment 0 is replaced.
+ *  Input: um_memory mem
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or is not profiled.
+ */
+void profiler_poll(um_memory mem)
+{
+    assert(mem && mem->profiler);
+    drain(mem);
+    if (dump_requested) {
+      dump_requested = 0;
+      dump(mem->profiler);
+    }
+}
+
+ /*
+ *  profiler_wait_input
+ *
+ *  Function: Waits for the UM's input, writing the profile whenever
+ *  SIGUSR1 asks meanwhile, since a blocked UM never reaches
+ *  profiler_poll. Blocks until fd is readable or at end of file.
+ *  SIGUSR1 is only unblocked inside ppoll, so a request cannot slip in
+ *  between the check and the wait.
+ *  Input: um_memory mem, int fd
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL or is not profiled.
+ */
+void profiler_wait_input(um_memory mem, int fd)
+{
+    assert(mem && mem->profiler);
+    sigset_t usr1, old;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    for (;;) {
+      pthread_sigmask(SIG_BLOCK, &usr1, &old);
+      int ready = 0;
+      if (!dump_requested)
+        ready = ppoll(&pfd, 1, NULL, &old);
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+      if (dump_requested)
+        profiler_poll(mem);
+      if (ready > 0)
+        return ;
+    }
+}
+
+ /*
+ *  profiler_getc
+ *
+ *  Function: Reads one byte of stdin for a profiled UM. Bytes are read
+ *  straight from the descriptor into the profiler's own buffer, instead
+ *  of through stdio, so that the UM only waits in profiler_wait_input
+ *  when no input is buffered at all.
+ *  Input: um_memory mem
+ *  Output: the byte read, or EOF at end of input or on a read error
+ *  Expectations: Will raise CRE if mem is NULL or is not profiled. stdin
+ *  must not have been read through stdio.
+ */
+int profiler_getc(um_memory mem)
+{
+    assert(mem && mem->profiler);
+    struct profiler *prof = mem->profiler;
+    while (prof->input_pos == prof->input_length) {
+      if (prof->input_eof)
+        return EOF;
+      profiler_wait_input(mem, STDIN_FILENO);
+      ssize_t n = read(STDIN_FILENO, prof->input, INPUT_BUFFER);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        prof->input_eof = 1;
+        return EOF;
+      }
+      prof->input_pos = 0;
+      prof->input_length = n;
+    }
+    return prof->input[prof->input_pos++];
+}
+
+ /*
+ *  on_sigprof (Private Helper Function)
+ *
+ *  Function: Records where the UM is. Only reads the UM state and writes
+ *  one ring slot, so it is async-signal-safe; a full ring drops the
+ *  sample. mem->code is NULL while segment 0 is being replaced, when
+ *  there is no image to charge the sample to, so it is not recorded.
+ *  Input: int signo
+ *  Output: None
+ *  Expectations: none
+ */
+static void on_sigprof(int signo)
+{
+    (void)signo;
+    um_memory mem = profiled;
+    if (mem == NULL)
+      return ;
+    struct um_code *code = mem->code;
+    if (code == NULL)
+      return ;
+    struct profiler *prof = mem->profiler;
+    size_t head = atomic_load_explicit(&prof->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&prof->tail, memory_order_acquire);
+    if (head - tail == SAMPLE_RING) {
+      atomic_fetch_add_explicit(&prof->dropped, 1, memory_order_relaxed);
+      return ;
+    }
+    struct sample *s = &prof->ring[head % SAMPLE_RING];
+    s->pc = mem->program_counter_index;
+    s->image = code->hash;
+    s->opcode = UNKNOWN_OP;
+    if (s->pc < code->length && code->ops[s->pc].opcode < UNKNOWN_OP)
+      s->opcode = code->ops[s->pc].opcode;
+    atomic_store_explicit(&prof->head, head + 1, memory_order_release);
+}
+
+static void on_sigusr1(int signo)
+{
+    (void)signo;
+    dump_requested = 1;
+}
+
+ /*
+ *  drain (Private Helper Function)
+ *
+ *  Function: Moves the samples out of the ring into the counts table,
+ *  keyed by image, basic block and opcode. Samples from a segment 0 that
+ *  has since been replaced keep their own program counter as block.
+ *  Input: um_memory mem
+ *  Output: None
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static void drain(um_memory mem)
+{
+    struct profiler *prof = mem->profiler;
+    size_t tail = atomic_load_explicit(&prof->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&prof->head, memory_order_acquire);
+    for (; tail != head; tail++) {
+      struct sample *s = &prof->ring[tail % SAMPLE_RING];
+      struct profile_entry probe;
+      probe.image = s->image;
+      probe.block = s->pc;
+      probe.opcode = s->opcode;
+      if (mem->code != NULL && s->image == mem->code->hash)
+        probe.block = code_block(mem->code, s->pc);
+      struct profile_entry *entry = Table_get(prof->counts, &probe);
+      if (entry == NULL) {
+        entry = malloc(sizeof(*entry));
+        assert(entry);
+        *entry = probe;
+        entry->count = 0;
+        Table_put(prof->counts, entry, entry);
+      }
+      entry->count++;
+    }
+    atomic_store_explicit(&prof->tail, tail, memory_order_release);
+}
+
+ /*
+ *  dump (Private Helper Function)
+ *
+ *  Function: Rewrites the profile file with one folded stack per line,
+ *  "um;image_<hash>;block_<leader>;<opcode> <samples>", the format read
+ *  by flamegraph tools. Dropped samples are reported on stderr.
+ *  Input: struct profiler *prof
+ *  Output: None
+ *  Expectations: none. A profile that cannot be written is reported on
+ *  stderr.
+ */
+static void dump(struct profiler *prof)
+{
+    FILE *fp = fopen(prof->path, "w");
+    if (fp == NULL) {
+      fprintf(stderr, "profiler: cannot write %s\n", prof->path);
+      return ;
+    }
+    Table_map(prof->counts, write_entry, fp);
+    fclose(fp);
+    unsigned long dropped = atomic_load(&prof->dropped);
+    if (dropped != 0)
+      fprintf(stderr, "profiler: %lu samples dropped\n", dropped);
+}
+
+static void write_entry(const void *key, void **value, void *cl)
+{
+    (void)key;
+    struct profile_entry *entry = *value;
+    fprintf((FILE *)cl, "um;image_%016llx;block_%08x;%s %lu\n",
+            (unsigned long long)entry->image, entry->block,
+            OP_NAMES[entry->opcode], entry->count);
+}
+
+static void free_entry(const void *key, void **value, void *cl)
+{
+    (void)key;
+    (void)cl;
+    free(*value);
+}
+
+static int entry_cmp(const void *x, const void *y)
+{
+    const struct profile_entry *a = x;
+    const struct profile_entry *b = y;
+    return a->image != b->image || a->block != b->block
+           || a->opcode != b->opcode;
+}
+
+static unsigned entry_hash(const void *key)
+{
+    const struct profile_entry *entry = key;
+    uint64_t h = entry->image ^ ((uint64_t)entry->block << 4) ^ entry->opcode;
+    return (unsigned)(h ^ (h >> 32));
+}
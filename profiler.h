@@ -0,0 +1,35 @@
+/**************************************************************
+*     Assignment: um
+*     Authors: Isaac Hudis, Erena Inoue
+*     Date: 10/19/26
+*     File: profiler.h
+*     Summary: Interface of profiler module, a SIGPROF sampling
+*     profiler that writes folded stacks grouped by basic block
+**************************************************************/
+
+#ifndef PROFILER_INCLUDED
+#define PROFILER_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include "segmem.h"
+
+/* highest sampling rate the interval timer can deliver */
+#define PROFILE_MAX_HZ 1000000
+
+/* starts sampling mem hz times per second of CPU time */
+struct profiler *profiler_start(um_memory mem, unsigned hz, const char *path);
+
+/* stops sampling, writes the profile and frees the profiler */
+void profiler_stop(um_memory mem);
+
+/* collects pending samples and writes the profile if SIGUSR1 asked */
+void profiler_poll(um_memory mem);
+
+/* waits for input on fd, writing the profile if asked */
+void profiler_wait_input(um_memory mem, int fd);
+
+/* reads one byte of stdin for a profiled UM, or EOF */
+int profiler_getc(um_memory mem);
+
+#endif
@@ -9,14 +9,22 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "segmem.h"
+#include "dedup.h"
+#include "codecache.h"
+#include "profiler.h"
 #include <stdint.h>
+#include <stddef.h>
 
 const int REGISTERS = 8;
 
+_Static_assert(offsetof(struct um_memory, ops_length) + sizeof(uint32_t) <= 64,
+               "hot UM state must fit in one cache line");
+
 /* 
 *  initialize_memory
 * 
-*  Function: Initialize all elements in the um_memory struct
+*  Function: Initialize all elements in the um_memory struct. The struct
+*  is aligned to a cache line so that its hot fields share one line.
 *  Input: None
 *  Output: initialized um_memory struct
 *  Expections: none, but will raise CRE when allocating a memory 
@@ -24,21 +32,32 @@ const int REGISTERS = 8;
 */
 um_memory initialize_memory()
 {
-   um_memory memory = malloc(sizeof(struct um_memory));
-   assert(memory);
-   memory->identifiers = Seq_new(8);
-   memory->registers = malloc(REGISTERS * sizeof(uint32_t));
-   assert(memory->registers);
+   um_memory memory = NULL;
+   int failed = posix_memalign((void **)&memory, 64, sizeof(struct um_memory));
+   assert(failed == 0 && memory);
+   memory->segment_capacity = 8;
+   memory->segments = malloc(memory->segment_capacity 
+                             * sizeof(struct um_segment));
+   assert(memory->segments);
+   memory->segment_count = 1;
+   memory->segments[0].words = NULL;
+   memory->segments[0].length = 0;
    memory->reusable_mem = Stack_new();
-   memory->program_counter_seg = 0;
    memory->program_counter_index = 0;
+   memory->ops = NULL;
+   memory->ops_length = 0;
+   memory->dedup = NULL;
+   memory->io = NULL;
+   memory->code = NULL;
+   memory->cache_dir = NULL;
+   memory->profiler = NULL;
+   memory->session = NULL;
 
    uint32_t initial_value = 0;
    for (int i = 0; i < REGISTERS; i++) {
      memory->registers[i] = initial_value;
    }
    
-   Seq_addhi(memory->identifiers, Seq_new(8));
    return memory;
 }
 
@@ -48,7 +67,8 @@ um_memory initialize_memory()
  *  Function: creates a new segment with a given number of words. Each
  *  word in the new segment is initialized to zero and reuse identifiers 
  *  from the stack if it is not emepty. Else, it will add the newly
- *  mapped segments to the back of identifers sequence. 
+ *  mapped segment to the back of the segment table, doubling the table
+ *  when it is full. 
  *  Input: uint32_t words, uint32_t register_index, um_memory mem
  *  Output: None
  *  Expectations: Will raise CRE if mem is NULL and if register_index
@@ -59,30 +79,28 @@ void map_segment(uint32_t words, uint32_t register_index, um_memory mem)
 {
     assert(register_index <= 7);
     assert(mem);
-    Seq_T toAdd = Seq_new(words);
-    for(uint32_t i = 0; i < words; i++) {
-      uint32_t *initial_value = malloc(sizeof(uint32_t));
-      assert(initial_value);
-      *initial_value = 0;
-      Seq_addhi(toAdd, initial_value); 
-    }  
+    uint32_t *toAdd = calloc(words ? words : 1, sizeof(uint32_t));
+    assert(toAdd);
+    uint32_t index;
     if (Stack_empty(mem->reusable_mem) == 0) {
       uint32_t *index_ptr = (uint32_t *)Stack_pop(mem->reusable_mem);
-      uint32_t index = *index_ptr;
+      index = *index_ptr;
       free(index_ptr);
-      Seq_T old_seq = Seq_get(mem->identifiers, index);
-      for (int i = 0; i < Seq_length(old_seq); i++) {
-        uint32_t *temp = Seq_get(old_seq, i);
-        free(temp);
-      }
-      Seq_free(&old_seq);
-      Seq_put(mem->identifiers, index, toAdd);
-      mem->registers[register_index] = index;
+      release_segment(mem, index);
     } else {
-      Seq_addhi(mem->identifiers, toAdd);
-      uint32_t new_index = Seq_length(mem->identifiers) - 1;
-      mem->registers[register_index] = new_index;
+      if (mem->segment_count == mem->segment_capacity) {
+        mem->segment_capacity *= 2;
+        mem->segments = realloc(mem->segments, mem->segment_capacity 
+                                               * sizeof(struct um_segment));
+        assert(mem->segments);
+      }
+      index = mem->segment_count++;
     }
+    mem->segments[index].words = toAdd;
+    mem->segments[index].length = words;
+    mem->registers[register_index] = index;
+    if (mem->dedup != NULL)
+      dedup_before_store(mem, index);
 }
 
  /* 
@@ -107,12 +125,37 @@ void unmap_segment(uint32_t register_index, um_memory mem)
     assert(ptr);
     *ptr = value;
     Stack_push(mem->reusable_mem, ptr);
+    if (mem->dedup != NULL)
+      dedup_unmap(mem, value);
+}
+
+ /* 
+ *  release_segment
+ * 
+ *  Function: Frees the words of a segment, unless dedup says other
+ *  segments still share them, and leaves the segment empty.
+ *  Input: um_memory mem, uint32_t index
+ *  Output: None
+ *  Expectations: Will raise CRE if mem is NULL and if index is not in
+ *  the segment table.
+ */
+void release_segment(um_memory mem, uint32_t index)
+{
+    assert(mem);
+    assert(index < mem->segment_count);
+    if (mem->dedup == NULL || dedup_release(mem, index))
+      free(mem->segments[index].words);
+    mem->segments[index].words = NULL;
+    mem->segments[index].length = 0;
 }
 
  /* 
  *  free_memory
  * 
- *  Function: Frees all allocated memory
+ *  Function: Frees all allocated memory. Segments shared through dedup
+ *  are only freed once, and dedup statistics are reported. The decoded
+ *  segment 0 is saved to the code cache if one is in use, after the
+ *  profile, if any, has been written.
  *  Input: um_memory mem
  *  Output: None
  *  Expectations: Will raise CRE if mem is NULL. 
@@ -120,20 +163,19 @@ void unmap_segment(uint32_t register_index, um_memory mem)
 void free_memory(um_memory mem)
 {
     assert(mem);
-    free(mem->registers);
-    for (int i = 0; i < Seq_length(mem->identifiers); i++) {
-      Seq_T toFree = Seq_get(mem->identifiers, i);
-      for (int j = 0; j < Seq_length(toFree); j++) {
-        uint32_t *temp = Seq_get(toFree, j);
-        free(temp);
-      }
-      Seq_free(&toFree);
-    }
-    Seq_free(&(mem->identifiers));
+    if (mem->profiler != NULL)
+      profiler_stop(mem);
+    if (mem->code != NULL)
+      code_free(mem);
+    for (uint32_t i = 0; i < mem->segment_count; i++)
+      release_segment(mem, i);
+    free(mem->segments);
+    if (mem->dedup != NULL)
+      dedup_free(&(mem->dedup));
     while (Stack_empty(mem->reusable_mem) != 1) {
       uint32_t *temp = Stack_pop(mem->reusable_mem);
       free(temp);
     }
     Stack_free(&(mem->reusable_mem));
     free(mem);
-}
\ No newline at end of file
+}
@@ -6,19 +6,49 @@
 *     Summary: Interface of segmem module
 **************************************************************/
 
+#ifndef SEGMEM_INCLUDED
+#define SEGMEM_INCLUDED
+
 #include <stdio.h>
 #include <stdlib.h>
-#include "seq.h"
 #include "stack.h"
 #include <assert.h>
 #include <stdint.h>
+#include "umio.h"
+
+struct dedup_state;
+struct um_code;
+struct profiler;
+struct um_session;
+struct um_op;
 
+/* one entry of the segment table */
+struct um_segment {
+  uint32_t *words;
+  uint32_t length;
+};
+
+/*
+ * The first cache line holds everything a typical instruction touches:
+ * the registers, the program counter, the decoded segment 0 it is
+ * fetched from and the segment table that loads and stores index.
+ */
 struct um_memory {
-  Seq_T identifiers;
-  uint32_t *registers;
-  Stack_T reusable_mem;
-  uint32_t program_counter_seg;
+  _Alignas(64) uint32_t registers[8];
   uint32_t program_counter_index;
+  uint32_t segment_count;
+  struct um_segment *segments;
+  struct um_op *ops;
+  uint32_t ops_length;
+
+  uint32_t segment_capacity;
+  Stack_T reusable_mem;
+  struct dedup_state *dedup;
+  umio io;
+  struct um_code *code;
+  const char *cache_dir;
+  struct profiler *profiler;
+  struct um_session *session;
 };
 
 typedef struct um_memory *um_memory;
@@ -30,7 +60,7 @@ void free_memory(um_memory mem);
 void map_segment(uint32_t words, uint32_t register_index, um_memory mem);
 void unmap_segment(uint32_t register_index, um_memory mem);
 
+/* frees a segment's words unless dedup still shares them */
+void release_segment(um_memory mem, uint32_t index);
 
-
-
- 
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+#!/bin/sh
+###############################################################
+#     Assignment: um
+#     Authors: Isaac Hudis, Erena Inoue
+#     Date: 10/19/26
+#     File: codecache_collision.sh
+#     Summary: Regression test for the code cache. A cache file
+#     whose header matches an image, as after a hash collision,
+#     must not be used unless it was decoded from the very same
+#     words.
+#     Usage: tests/codecache_collision.sh [path to um]
+###############################################################
+
+UM=${1:-./um}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+{
+  printf '\322\000\000\101'    # 0: loadval r1 = 'A'
+  printf '\240\000\000\001'    # 1: output r1
+  printf '\160\000\000\000'    # 2: halt
+} > "$DIR/a.um"
+{
+  printf '\322\000\000\102'    # 0: loadval r1 = 'B'
+  printf '\240\000\000\001'    # 1: output r1
+  printf '\160\000\000\000'    # 2: halt
+} > "$DIR/b.um"
+
+mkdir "$DIR/cache"
+"$UM" -c "$DIR/cache" "$DIR/a.um" > /dev/null
+a_file=$(ls "$DIR/cache")
+"$UM" -c "$DIR/cache" "$DIR/b.um" > /dev/null
+b_file=$(ls "$DIR/cache" | grep -v "$a_file")
+if [ -z "$a_file" ] || [ -z "$b_file" ]; then
+  echo "codecache_collision: no cache files written" >&2
+  exit 1
+fi
+
+# give a's decoding b's name and b's hash (bytes 16-23 of the header)
+b_hash=${b_file%.umc}
+cp "$DIR/cache/$a_file" "$DIR/cache/$b_file"
+i=14
+while [ $i -ge 0 ]; do
+  printf "\\$(printf '%03o' "0x$(echo "$b_hash" | cut -c$((i + 1))-$((i + 2)))")"
+  i=$((i - 2))
+done | dd of="$DIR/cache/$b_file" bs=1 seek=16 conv=notrunc 2> /dev/null
+
+out=$("$UM" -c "$DIR/cache" "$DIR/b.um")
+if [ "$out" != "B" ]; then
+  echo "codecache_collision: printed '$out', expected 'B'" >&2
+  exit 1
+fi
+echo "codecache_collision: ok"
@@ -0,0 +1,42 @@
+#!/bin/sh
+###############################################################
+#     Assignment: um
+#     Authors: Isaac Hudis, Erena Inoue
+#     Date: 10/19/26
+#     File: codecache_smc.sh
+#     Summary: Regression test for the code cache. A program that
+#     stores over its own segment 0 must not leave its patched
+#     decoding in the cache file keyed by its original contents.
+#     Usage: tests/codecache_smc.sh [path to um]
+###############################################################
+
+UM=${1:-./um}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+# prints 'A', stores a halt over word 1 (already executed), prints 'B'
+{
+  printf '\322\000\000\101'    # 0: loadval r1 = 'A'
+  printf '\240\000\000\001'    # 1: output r1
+  printf '\326\000\000\007'    # 2: loadval r3 = 7
+  printf '\330\000\000\020'    # 3: loadval r4 = 16
+  printf '\100\000\000\334'    # 4: r3 = r3 * r4
+  printf '\333\000\000\000'    # 5: loadval r5 = 1 << 24
+  printf '\100\000\000\335'    # 6: r3 = r3 * r5 (halt instruction)
+  printf '\320\000\000\000'    # 7: loadval r0 = 0
+  printf '\334\000\000\001'    # 8: loadval r6 = 1
+  printf '\040\000\000\063'    # 9: m[r0][r6] = r3
+  printf '\336\000\000\102'    # 10: loadval r7 = 'B'
+  printf '\240\000\000\007'    # 11: output r7
+  printf '\160\000\000\000'    # 12: halt
+} > "$DIR/smc.um"
+
+mkdir "$DIR/cache"
+for run in 1 2 3; do
+  out=$("$UM" -c "$DIR/cache" "$DIR/smc.um")
+  if [ "$out" != "AB" ]; then
+    echo "codecache_smc: run $run printed '$out', expected 'AB'" >&2
+    exit 1
+  fi
+done
+echo "codecache_smc: ok"
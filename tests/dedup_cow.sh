@@ -0,0 +1,84 @@
+#!/bin/sh
+###############################################################
+#     Assignment: um
+#     Authors: Isaac Hudis, Erena Inoue
+#     Date: 10/19/26
+#     File: dedup_cow.sh
+#     Summary: Regression test for copy-on-write under -d. Two
+#     copies of segment 0 are left clean until a scan merges all
+#     three; a store to one copy, and a store to segment 0 after
+#     load program shared another copy as segment 0, must not
+#     show through in the other segments.
+#     Usage: tests/dedup_cow.sh [path to um]
+###############################################################
+
+UM=${1:-./um}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+word() {
+  printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $(($1 >> 24 & 255)) \
+    $(($1 >> 16 & 255)) $(($1 >> 8 & 255)) $(($1 & 255)))"
+}
+op() { word $(( ($1 << 28) | ($2 << 6) | ($3 << 3) | $4 )); }
+lv() { word $(( (13 << 28) | ($1 << 25) | $2 )); }
+
+# r0 stays 0; the image is 256 words so that scans hash it
+{
+  lv 7 256                # 0: r7 = 256
+  op 8 0 1 7              # 1: r1 = map r7 words
+  op 8 0 2 7              # 2: r2 = map r7 words
+  lv 5 256                # 3: r5 = 256
+  op 6 4 0 0              # 4: r4 = ~0
+  op 3 5 5 4              # 5: r5 = r5 - 1
+  op 1 6 0 5              # 6: r6 = m[r0][r5]
+  op 2 1 5 6              # 7: m[r1][r5] = r6
+  op 2 2 5 6              # 8: m[r2][r5] = r6
+  lv 3 4                  # 9: r3 = 4
+  lv 4 13                 # 10: r4 = 13
+  op 0 4 3 5              # 11: if r5 then r4 = r3
+  op 12 0 0 4             # 12: goto r4
+  lv 5 2000000            # 13: r5 = 2000000, long enough for 2 scans
+  op 6 4 0 0              # 14: r4 = ~0
+  op 3 5 5 4              # 15: r5 = r5 - 1
+  lv 3 14                 # 16: r3 = 14
+  lv 4 20                 # 17: r4 = 20
+  op 0 4 3 5              # 18: if r5 then r4 = r3
+  op 12 0 0 4             # 19: goto r4
+  lv 6 88                 # 20: r6 = 'X'
+  lv 5 100                # 21: r5 = 100
+  op 2 1 5 6              # 22: m[r1][r5] = r6
+  op 1 3 1 5              # 23: r3 = m[r1][r5]
+  op 10 0 0 3             # 24: output r3
+  op 1 3 2 5              # 25: r3 = m[r2][r5]
+  op 10 0 0 3             # 26: output r3
+  lv 4 29                 # 27: r4 = 29
+  op 12 0 2 4             # 28: load program r2, goto r4
+  lv 6 90                 # 29: r6 = 'Z'
+  op 2 0 5 6              # 30: m[r0][r5] = r6
+  op 1 3 0 5              # 31: r3 = m[r0][r5]
+  op 10 0 0 3             # 32: output r3
+  op 1 3 2 5              # 33: r3 = m[r2][r5]
+  op 10 0 0 3             # 34: output r3
+  op 7 0 0 0              # 35: halt
+  i=36
+  while [ $i -lt 256 ]; do
+    word 89               # 36-255: 'Y'
+    i=$((i + 1))
+  done
+} > "$DIR/cow.um"
+
+for flags in "" "-d"; do
+  out=$("$UM" $flags "$DIR/cow.um" 2> "$DIR/err")
+  if [ "$out" != "XYZY" ]; then
+    echo "dedup_cow: um $flags printed '$out', expected 'XYZY'" >&2
+    exit 1
+  fi
+done
+merged=$(sed -n 's/.* \([0-9]*\) merged.*/\1/p' "$DIR/err")
+copies=$(sed -n 's/.* \([0-9]*\) copy-on-write.*/\1/p' "$DIR/err")
+if [ "${merged:-0}" -eq 0 ] || [ "${copies:-0}" -eq 0 ]; then
+  echo "dedup_cow: expected merges and copies, got: $(cat "$DIR/err")" >&2
+  exit 1
+fi
+echo "dedup_cow: ok"
@@ -0,0 +1,61 @@
+#!/bin/bash
+###############################################################
+#     Assignment: um
+#     Authors: Isaac Hudis, Erena Inoue
+#     Date: 10/19/26
+#     File: sched_dedup_stats.sh
+#     Summary: Regression test for -l with -d. The server must
+#     report the dedup statistics of all its UMs once, when it is
+#     stopped, instead of once per connection. Uses bash for its
+#     /dev/tcp connections.
+#     Usage: tests/sched_dedup_stats.sh [path to um]
+###############################################################
+
+UM=${1:-./um}
+DIR=$(mktemp -d) || exit 1
+PORT=$((20000 + $$ % 20000))
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER 2> /dev/null; rm -rf "$DIR"' EXIT
+
+{
+  printf '\322\000\000\101'    # 0: loadval r1 = 'A'
+  printf '\240\000\000\001'    # 1: output r1
+  printf '\160\000\000\000'    # 2: halt
+} > "$DIR/a.um"
+
+"$UM" -l $PORT -d "$DIR/a.um" 2> "$DIR/err" &
+SERVER=$!
+
+connect() {
+  exec 3<> /dev/tcp/127.0.0.1/$PORT || return 1
+  out=$(cat <&3)
+  exec 3<&-
+  [ "$out" = "A" ]
+}
+
+tries=0
+until connect 2> /dev/null; do
+  tries=$((tries + 1))
+  if [ $tries -ge 50 ]; then
+    echo "sched_dedup_stats: server did not answer on port $PORT" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+for run in 2 3 4 5; do
+  if ! connect; then
+    echo "sched_dedup_stats: connection $run did not print 'A'" >&2
+    exit 1
+  fi
+done
+
+kill -TERM $SERVER
+wait $SERVER
+SERVER=
+lines=$(grep -c '^dedup:' "$DIR/err")
+if [ "$lines" != 1 ] || ! grep -q '^dedup: 5 UMs,' "$DIR/err"; then
+  echo "sched_dedup_stats: expected one report for 5 UMs, got:" >&2
+  cat "$DIR/err" >&2
+  exit 1
+fi
+echo "sched_dedup_stats: ok"
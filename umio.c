@@ -0,0 +1,440 @@
+ /**************************************************************
+ *     Assignment: um
+ *     Authors: Isaac Hudis, Erena Inoue
+ *     Date: 10/19/26
+ *     File: umio.c
+ *     Summary: Implementation of umio module. The UM is the only
+ *     producer of the output ring and the only consumer of the
+ *     input ring; the I/O thread is the other end of both. Either
+ *     side sleeps in poll when it has to wait for the other, and
+ *     is woken through its own pipe only when it has announced
+ *     that it sleeps.
+ **************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "umio.h"
+
+#define RING_SIZE (1u << 16)
+#define RING_MASK (RING_SIZE - 1)
+#define CACHE_LINE 64
+#define IDLE_SPINS 64
+#define WAIT_SPINS 256
+
+struct ring {
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    size_t cached_tail;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    size_t cached_head;
+    _Alignas(CACHE_LINE) unsigned char buf[RING_SIZE];
+};
+
+struct umio {
+    struct ring out;
+    struct ring in;
+    _Alignas(CACHE_LINE) atomic_int sleeping;
+    atomic_int um_sleeping;
+    atomic_int input_eof;
+    atomic_int output_broken;
+    atomic_int stop;
+    int in_fd;
+    int out_fd;
+    int wake[2];
+    int um_wake[2];
+    pthread_t thread;
+};
+
+static void *io_thread(void *arg);
+static void kick(atomic_int *sleeping, int fd);
+static int output_closed(umio io);
+static int output_ready(umio io);
+static int arm(umio io, int (*ready)(umio io));
+static void wait_for(umio io, int (*ready)(umio io));
+
+ /*
+ *  umio_new
+ *
+ *  Function: Allocates both rings and starts the I/O thread. The thread
+ *  blocks every signal so that signals keep being delivered to the UM.
+ *  Input: int in_fd, int out_fd
+ *  Output: new umio
+ *  Expectations: Will raise CRE if allocating memory, creating the wake
+ *  pipes or starting the thread is unsuccessful.
+ */
+umio umio_new(int in_fd, int out_fd)
+{
+    umio io = aligned_alloc(CACHE_LINE, sizeof(struct umio));
+    assert(io);
+    atomic_init(&io->out.head, 0);
+    atomic_init(&io->out.tail, 0);
+    atomic_init(&io->in.head, 0);
+    atomic_init(&io->in.tail, 0);
+    io->out.cached_tail = io->out.cached_head = 0;
+    io->in.cached_tail = io->in.cached_head = 0;
+    atomic_init(&io->sleeping, 0);
+    atomic_init(&io->um_sleeping, 0);
+    atomic_init(&io->input_eof, 0);
+    atomic_init(&io->output_broken, 0);
+    atomic_init(&io->stop, 0);
+    io->in_fd = in_fd;
+    io->out_fd = out_fd;
+    int rc = pipe(io->wake);
+    assert(rc == 0);
+    rc = pipe2(io->um_wake, O_NONBLOCK);
+    assert(rc == 0);
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rc = pthread_create(&io->thread, NULL, io_thread, io);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    assert(rc == 0);
+    return io;
+}
+
+ /*
+ *  umio_free
+ *
+ *  Function: Asks the I/O thread to stop once the output ring is empty,
+ *  waits for it and frees the rings.
+ *  Input: umio *io
+ *  Output: None
+ *  Expectations: Will raise CRE if io or *io is NULL.
+ */
+void umio_free(umio *io)
+{
+    assert(io && *io);
+    umio u = *io;
+    atomic_store(&u->stop, 1);
+    char c = 0;
+    while (write(u->wake[1], &c, 1) < 0 && errno == EINTR)
+      ;
+    pthread_join(u->thread, NULL);
+    close(u->wake[0]);
+    close(u->wake[1]);
+    close(u->um_wake[0]);
+    close(u->um_wake[1]);
+    free(u);
+    *io = NULL;
+}
+
+ /*
+ *  umio_put
+ *
+ *  Function: Appends one byte to the output ring. When the ring is full
+ *  the UM waits for the I/O thread to drain it (backpressure). Once the
+ *  I/O thread has seen EPIPE, SIGPIPE is raised on the UM's thread, as a
+ *  direct write would have done, and the byte is dropped.
+ *  Input: umio io, uint32_t byte
+ *  Output: None
+ *  Expectations: Will raise CRE if io is NULL.
+ */
+void umio_put(umio io, uint32_t byte)
+{
+    assert(io);
+    if (output_closed(io))
+      return ;
+    struct ring *r = &io->out;
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->cached_tail == RING_SIZE) {
+      r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+      if (head - r->cached_tail == RING_SIZE) {
+        kick(&io->sleeping, io->wake[1]);
+        wait_for(io, output_ready);
+        if (output_closed(io))
+          return ;
+        r->cached_tail = atomic_load_explicit(&r->tail,
+                                              memory_order_acquire);
+      }
+    }
+    r->buf[head & RING_MASK] = (unsigned char)byte;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    kick(&io->sleeping, io->wake[1]);
+}
+
+ /*
+ *  umio_get
+ *
+ *  Function: Takes one byte from the input ring, waiting for the I/O
+ *  thread if the ring is empty. End of input is only reported once every
+ *  byte read before it has been consumed.
+ *  Input: umio io
+ *  Output: the byte read, or a word of all ones at end of input
+ *  Expectations: Will raise CRE if io is NULL.
+ */
+uint32_t umio_get(umio io)
+{
+    assert(io);
+    struct ring *r = &io->in;
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail == r->cached_head) {
+      wait_for(io, umio_input_ready);
+      r->cached_head = atomic_load_explicit(&r->head, memory_order_acquire);
+      if (tail == r->cached_head)
+        return ~(uint32_t)0;
+    }
+    uint32_t byte = r->buf[tail & RING_MASK];
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    kick(&io->sleeping, io->wake[1]);
+    return byte;
+}
+
+ /*
+ *  umio_input_ready
+ *
+ *  Function: Tells whether a byte or the end of input is waiting in the
+ *  input ring, so that umio_get would not wait.
+ *  Input: umio io
+ *  Output: 1 if input is ready, 0 if not
+ *  Expectations: Will raise CRE if io is NULL.
+ */
+int umio_input_ready(umio io)
+{
+    assert(io);
+    struct ring *r = &io->in;
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    return atomic_load_explicit(&r->head, memory_order_acquire) != tail
+           || atomic_load_explicit(&io->input_eof, memory_order_acquire);
+}
+
+ /*
+ *  umio_input_fd
+ *
+ *  Function: Announces that the UM is about to wait for input somewhere
+ *  else than in umio_get, so that the I/O thread wakes it through the
+ *  returned descriptor once it has read some.
+ *  Input: umio io
+ *  Output: a descriptor that becomes readable when umio_input_ready may
+ *  have changed, or -1 if input is ready already
+ *  Expectations: Will raise CRE if io is NULL.
+ */
+int umio_input_fd(umio io)
+{
+    assert(io);
+    return arm(io, umio_input_ready);
+}
+
+ /*
+ *  kick (Private Helper Function)
+ *
+ *  Function: Wakes the other side, through the write end fd of its pipe,
+ *  if it announced that it is sleeping. The fence pairs with the one the
+ *  sleeper issues after announcing, so that either it sees the ring
+ *  update or this sees its sleeping flag.
+ *  Input: atomic_int *sleeping, int fd
+ *  Output: None
+ *  Expectations: none
+ */
+static void kick(atomic_int *sleeping, int fd)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(sleeping, memory_order_relaxed) == 0)
+      return ;
+    if (atomic_exchange(sleeping, 0) == 0)
+      return ;
+    char c = 0;
+    while (write(fd, &c, 1) < 0 && errno == EINTR)
+      ;
+}
+
+ /*
+ *  output_closed (Private Helper Function)
+ *
+ *  Function: Tells whether the I/O thread found the reader of the output
+ *  gone, raising SIGPIPE the first time it is asked after that. If
+ *  SIGPIPE is ignored the UM keeps running and its output is dropped.
+ *  Input: umio io
+ *  Output: 1 if output is being dropped, 0 if not
+ *  Expectations: none
+ */
+static int output_closed(umio io)
+{
+    if (atomic_load_explicit(&io->output_broken, memory_order_relaxed) == 0)
+      return 0;
+    if (atomic_exchange(&io->output_broken, 2) == 1)
+      raise(SIGPIPE);
+    return 1;
+}
+
+ /*
+ *  output_ready (Private Helper Function)
+ *
+ *  Function: Tells whether umio_put can go on: the output ring has room
+ *  or the output is being dropped.
+ *  Input: umio io
+ *  Output: 1 if umio_put would not wait, 0 if not
+ *  Expectations: none
+ */
+static int output_ready(umio io)
+{
+    struct ring *r = &io->out;
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    return head - atomic_load_explicit(&r->tail, memory_order_acquire)
+           != RING_SIZE
+           || atomic_load_explicit(&io->output_broken, memory_order_relaxed);
+}
+
+ /*
+ *  arm (Private Helper Function)
+ *
+ *  Function: Announces that the UM sleeps until ready holds, then checks
+ *  it once more, since the I/O thread may have changed the rings before
+ *  it saw the announcement. Wake-ups left over from an earlier wait are
+ *  drained first.
+ *  Input: umio io, int (*ready)(umio io)
+ *  Output: the descriptor to poll, or -1 if ready holds already
+ *  Expectations: none
+ */
+static int arm(umio io, int (*ready)(umio io))
+{
+    char drain[64];
+    while (read(io->um_wake[0], drain, sizeof(drain)) > 0)
+      ;
+    atomic_store(&io->um_sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ready(io)) {
+      atomic_store(&io->um_sleeping, 0);
+      return -1;
+    }
+    return io->um_wake[0];
+}
+
+ /*
+ *  wait_for (Private Helper Function)
+ *
+ *  Function: Waits until ready holds: first by yielding the CPU, since
+ *  the I/O thread usually catches up quickly, then by sleeping in poll
+ *  until the I/O thread wakes the UM, so a UM blocked on I/O does not
+ *  burn a core.
+ *  Input: umio io, int (*ready)(umio io)
+ *  Output: None
+ *  Expectations: none
+ */
+static void wait_for(umio io, int (*ready)(umio io))
+{
+    for (unsigned spins = 0; !ready(io); spins++) {
+      if (spins < WAIT_SPINS) {
+        sched_yield();
+        continue;
+      }
+      struct pollfd pfd = { arm(io, ready), POLLIN, 0 };
+      if (pfd.fd >= 0)
+        poll(&pfd, 1, -1);
+    }
+}
+
+ /*
+ *  io_thread (Private Helper Function)
+ *
+ *  Function: Moves bytes from the output ring to out_fd and from in_fd to
+ *  the input ring until stopped. Uses poll so that a slow reader of the
+ *  output never keeps input from being prefetched, and the other way
+ *  around. Wakes the UM after every change to the rings, in case it
+ *  waits on one.
+ *  Input: the umio, as void *
+ *  Output: NULL
+ *  Expectations: none. Output that can no longer be written is dropped,
+ *  and EPIPE is reported to the UM through output_broken.
+ */
+static void *io_thread(void *arg)
+{
+    umio io = arg;
+    struct ring *out = &io->out;
+    struct ring *in = &io->in;
+    for (;;) {
+      size_t out_head = atomic_load_explicit(&out->head, memory_order_acquire);
+      size_t out_tail = atomic_load_explicit(&out->tail, memory_order_relaxed);
+      size_t in_head = atomic_load_explicit(&in->head, memory_order_relaxed);
+      size_t in_tail = atomic_load_explicit(&in->tail, memory_order_acquire);
+      int want_out = out_head != out_tail;
+      int want_in = !atomic_load_explicit(&io->input_eof,
+                                          memory_order_relaxed)
+                    && in_head - in_tail != RING_SIZE;
+      int stopping = atomic_load(&io->stop);
+      if (stopping && !want_out)
+        return NULL;
+
+      struct pollfd fds[3];
+      int nfds = 0;
+      fds[nfds++] = (struct pollfd){ io->wake[0], POLLIN, 0 };
+      if (want_out)
+        fds[nfds++] = (struct pollfd){ io->out_fd, POLLOUT, 0 };
+      if (want_in && !stopping)
+        fds[nfds++] = (struct pollfd){ io->in_fd, POLLIN, 0 };
+
+      /* stay awake briefly while the UM is busy with I/O, then announce
+         sleep and recheck the rings the UM may have changed */
+      if (!want_out && !stopping) {
+        for (int i = 0; i < IDLE_SPINS; i++) {
+          if (atomic_load_explicit(&out->head, memory_order_relaxed)
+              != out_head)
+            break;
+          sched_yield();
+        }
+      }
+      atomic_store(&io->sleeping, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (atomic_load_explicit(&out->head, memory_order_relaxed) != out_head
+          || atomic_load_explicit(&in->tail, memory_order_relaxed) != in_tail) {
+        atomic_store(&io->sleeping, 0);
+        continue;
+      }
+      if (poll(fds, nfds, -1) < 0) {
+        atomic_store(&io->sleeping, 0);
+        assert(errno == EINTR);
+        continue;
+      }
+      atomic_store(&io->sleeping, 0);
+
+      for (int i = 0; i < nfds; i++) {
+        if (fds[i].revents == 0)
+          continue;
+        if (fds[i].fd == io->wake[0]) {
+          char drain[64];
+          while (read(io->wake[0], drain, sizeof(drain)) < 0
+                 && errno == EINTR)
+            ;
+        } else if (fds[i].events == POLLOUT) {
+          size_t start = out_tail & RING_MASK;
+          size_t length = out_head - out_tail;
+          if (length > RING_SIZE - start)
+            length = RING_SIZE - start;
+          ssize_t n = write(io->out_fd, out->buf + start, length);
+          if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+          if (n < 0) {
+            if (errno == EPIPE)
+              atomic_store(&io->output_broken, 1);
+            n = length;    /* reader is gone: drop output */
+          }
+          atomic_store_explicit(&out->tail, out_tail + n,
+                                memory_order_release);
+        } else {
+          size_t start = in_head & RING_MASK;
+          size_t length = RING_SIZE - (in_head - in_tail);
+          if (length > RING_SIZE - start)
+            length = RING_SIZE - start;
+          ssize_t n = read(io->in_fd, in->buf + start, length);
+          if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+          if (n <= 0) {
+            atomic_store_explicit(&io->input_eof, 1, memory_order_release);
+            continue;
+          }
+          atomic_store_explicit(&in->head, in_head + n,
+                                memory_order_release);
+        }
+      }
+      kick(&io->um_sleeping, io->um_wake[1]);
+    }
+}
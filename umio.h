@@ -0,0 +1,35 @@
+/**************************************************************
+*     Assignment: um
+*     Authors: Isaac Hudis, Erena Inoue
+*     Date: 10/19/26
+*     File: umio.h
+*     Summary: Interface of umio module, an I/O thread connected
+*     to the UM by single-producer/single-consumer rings
+**************************************************************/
+
+#ifndef UMIO_INCLUDED
+#define UMIO_INCLUDED
+
+#include <stdint.h>
+
+typedef struct umio *umio;
+
+/* starts the I/O thread reading in_fd and writing out_fd */
+umio umio_new(int in_fd, int out_fd);
+
+/* drains pending output, stops the I/O thread and frees it */
+void umio_free(umio *io);
+
+/* queues one output byte, waiting while the output ring is full */
+void umio_put(umio io, uint32_t byte);
+
+/* 1 if umio_get would return without waiting */
+int umio_input_ready(umio io);
+
+/* a descriptor to poll until input may be ready, or -1 if it is */
+int umio_input_fd(umio io);
+
+/* dequeues one input byte, or all ones once input has ended */
+uint32_t umio_get(umio io);
+
+#endif
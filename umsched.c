@@ -0,0 +1,596 @@
+ /**************************************************************
+ *     Assignment: um
+ *     Authors: Isaac Hudis, Erena Inoue
+ *     Date: 10/19/26
+ *     File: umsched.c
+ *     Summary: Implementation of umsched module. Every connection
+ *     gets a session holding its own UM and input and output
+ *     queues. Runnable sessions take turns running a quantum of
+ *     instructions; the instruction count is only compared at
+ *     load_program, the one instruction that ends a basic block,
+ *     but every instruction is still checked for halt and for
+ *     input that is not ready.
+ *     A session whose UM needs input that has not arrived, or
+ *     whose output is not being read, is parked until epoll says
+ *     its connection is ready. A session whose connection fails is
+ *     torn down with its UM, whether or not the UM has halted.
+ *     When accept runs out of descriptors or memory, the listening
+ *     socket leaves epoll until a session is freed or a moment has
+ *     passed, rather than waking epoll again at once.
+ *     SIGINT and SIGTERM are only let in while the server waits in
+ *     epoll; they stop it, tearing every session down.
+ **************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "umsched.h"
+#include "filereader.h"
+#include "codecache.h"
+#include "dedup.h"
+
+#define QUEUE_LIMIT (1u << 16)
+#define MAX_EVENTS 256
+#define ACCEPT_PAUSE_MS 100
+
+static const unsigned HALT_OP = 7;
+static const unsigned LOAD_PROGRAM_OP = 12;
+
+enum session_state { RUNNABLE, WAIT_INPUT, WAIT_OUTPUT, HALTED };
+
+struct byte_queue {
+    unsigned char *data;
+    size_t head;
+    size_t length;
+    size_t capacity;
+};
+
+struct um_session {
+    um_memory mem;
+    int fd;
+    int registered;
+    uint32_t events;
+    int input_eof;
+    int closed;
+    enum session_state state;
+    uint64_t executed;
+    struct byte_queue in;
+    struct byte_queue out;
+    struct um_session *next;
+    struct um_session *live_prev;
+    struct um_session *live_next;
+};
+
+struct run_queue {
+    struct um_session *first;
+    struct um_session *last;
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static struct um_session *session_new(struct um_session **live,
+                                      um_memory image, int fd,
+                                      struct dedup_state *totals);
+static void session_free(struct um_session **live,
+                         struct um_session *session);
+static void run_quantum(struct um_session *session, int dedup);
+static void read_input(struct um_session *session);
+static void flush_output(struct um_session *session);
+static void update_events(int epoll_fd, struct um_session *session);
+static void enqueue(struct run_queue *queue, struct um_session *session);
+static struct um_session *dequeue(struct run_queue *queue);
+static void queue_push(struct byte_queue *queue, const unsigned char *bytes,
+                       size_t length);
+static int listen_on(int port);
+static void set_accepting(int epoll_fd, int listen_fd, int on);
+static long now_ms(void);
+static void on_stop(int signo);
+
+ /*
+ *  sched_serve
+ *
+ *  Function: Accepts connections on port and runs a fresh copy of the
+ *  image for each one, until SIGINT or SIGTERM. Then every session is
+ *  torn down, whether or not its UM has halted, and the dedup statistics
+ *  of all the UMs are reported once. The UMs read the
+ *  connection as input and write their output to it; the connection is
+ *  closed once the UM halts and its output has been sent. A connection
+ *  that fails (a send error, EPOLLHUP or EPOLLERR) ends its UM even if it
+ *  has not halted. A runnable session is in the run queue, so a failed
+ *  one is only freed when its turn comes in the round that follows.
+ *  Connections are not accepted while the process is out of descriptors
+ *  or memory, until a session is freed or ACCEPT_PAUSE_MS have passed.
+ *  Input: um_memory image (segment 0 holds the program; its cache_dir is
+ *  used by every UM), int port, int dedup (non-zero enables dedup in
+ *  every UM)
+ *  Output: None
+ *  Expectations: Will raise CRE if image is NULL, or if the port cannot
+ *  be listened on or epoll cannot be set up.
+ */
+void sched_serve(um_memory image, int port, int dedup)
+{
+    assert(image);
+    int listen_fd = listen_on(port);
+    int epoll_fd = epoll_create1(0);
+    assert(epoll_fd >= 0);
+    set_accepting(epoll_fd, listen_fd, 1);
+    int accepting = 1;
+    int freed = 0;
+    long resume_at = 0;
+    struct dedup_state *totals = dedup ? dedup_new(NULL) : NULL;
+    struct um_session *live = NULL;
+
+    sigset_t stop_signals, old_mask, wait_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    struct sigaction sa, old_int, old_term;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    stop_requested = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    struct run_queue runnable = { NULL, NULL };
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested) {
+      if (!accepting && (freed || now_ms() >= resume_at)) {
+        set_accepting(epoll_fd, listen_fd, 1);
+        accepting = 1;
+      }
+      int timeout = runnable.first != NULL ? 0
+                    : accepting ? -1 : ACCEPT_PAUSE_MS;
+      int n = epoll_pwait(epoll_fd, events, MAX_EVENTS, timeout,
+                          &wait_mask);
+      if (n < 0) {
+        assert(errno == EINTR);
+        continue;
+      }
+      for (int i = 0; i < n; i++) {
+        struct um_session *session = events[i].data.ptr;
+        if (session == NULL) {
+          int fd;
+          while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+            session = session_new(&live, image, fd, totals);
+            update_events(epoll_fd, session);
+            enqueue(&runnable, session);
+          }
+          if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+              || errno == ENOMEM) {
+            set_accepting(epoll_fd, listen_fd, 0);
+            accepting = 0;
+            freed = 0;
+            resume_at = now_ms() + ACCEPT_PAUSE_MS;
+          }
+          continue;
+        }
+        if (events[i].events & (EPOLLHUP | EPOLLERR))
+          session->closed = 1;
+        if (!session->closed && (events[i].events & EPOLLIN))
+          read_input(session);
+        if (!session->closed && (events[i].events & EPOLLOUT))
+          flush_output(session);
+        if (session->closed
+            || (session->state == HALTED && session->out.length == 0)) {
+          if (session->state != RUNNABLE) {
+            session_free(&live, session);
+            freed = 1;
+          }
+          continue;
+        }
+        if ((session->state == WAIT_INPUT && session_input_ready(session))
+            || (session->state == WAIT_OUTPUT
+                && session->out.length < QUEUE_LIMIT)) {
+          session->state = RUNNABLE;
+          enqueue(&runnable, session);
+        }
+        update_events(epoll_fd, session);
+      }
+
+      /* one round: every session runnable now gets one quantum */
+      struct um_session *end = runnable.last;
+      while (end != NULL) {
+        struct um_session *session = dequeue(&runnable);
+        if (!session->closed) {
+          run_quantum(session, dedup);
+          flush_output(session);
+        }
+        if (session->closed
+            || (session->state == HALTED && session->out.length == 0)) {
+          session_free(&live, session);
+          freed = 1;
+        } else if (session->state == RUNNABLE)
+          enqueue(&runnable, session);
+        else
+          update_events(epoll_fd, session);
+        if (session == end)
+          break;
+      }
+    }
+
+    while (live != NULL)
+      session_free(&live, live);
+    if (totals != NULL)
+      dedup_free(&totals);
+    close(epoll_fd);
+    close(listen_fd);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+ /*
+ *  session_input_ready
+ *
+ *  Function: Tells whether the input instruction can complete now
+ *  Input: struct um_session *session
+ *  Output: 1 if a byte or the end of input is available, 0 if not
+ *  Expectations: Will raise CRE if session is NULL.
+ */
+int session_input_ready(struct um_session *session)
+{
+    assert(session);
+    return session->in.length > 0 || session->input_eof;
+}
+
+ /*
+ *  session_getc
+ *
+ *  Function: Takes the next byte of the session's input
+ *  Input: struct um_session *session
+ *  Output: the byte, or a word of all ones once input has ended
+ *  Expectations: Will raise CRE if session is NULL or if no input is
+ *  ready.
+ */
+uint32_t session_getc(struct um_session *session)
+{
+    assert(session_input_ready(session));
+    struct byte_queue *in = &session->in;
+    if (in->length == 0)
+      return ~(uint32_t)0;
+    uint32_t byte = in->data[in->head];
+    in->head++;
+    in->length--;
+    return byte;
+}
+
+ /*
+ *  session_putc
+ *
+ *  Function: Queues one byte of output; it is sent after the quantum.
+ *  Input: struct um_session *session, uint32_t byte
+ *  Output: None
+ *  Expectations: Will raise CRE if session is NULL or if allocating
+ *  memory is unsuccessful.
+ */
+void session_putc(struct um_session *session, uint32_t byte)
+{
+    assert(session);
+    unsigned char c = byte;
+    queue_push(&session->out, &c, 1);
+}
+
+ /*
+ *  session_new (Private Helper Function)
+ *
+ *  Function: Creates a UM running a copy of the image's segment 0 from
+ *  its first instruction, connected to fd, and adds it to the live
+ *  sessions. With dedup its statistics are added to totals.
+ *  Input: struct um_session **live, um_memory image, int fd, struct
+ *  dedup_state *totals (NULL disables dedup)
+ *  Output: new runnable session
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static struct um_session *session_new(struct um_session **live,
+                                      um_memory image, int fd,
+                                      struct dedup_state *totals)
+{
+    struct um_session *session = calloc(1, sizeof(*session));
+    assert(session);
+    session->fd = fd;
+    session->state = RUNNABLE;
+    um_memory mem = initialize_memory();
+    struct um_segment *program = &image->segments[0];
+    uint32_t length = program->length;
+    mem->segments[0].words = malloc((length ? length : 1) * sizeof(uint32_t));
+    assert(mem->segments[0].words);
+    memcpy(mem->segments[0].words, program->words, length * sizeof(uint32_t));
+    mem->segments[0].length = length;
+    if (totals != NULL)
+      mem->dedup = dedup_new(totals);
+    mem->cache_dir = image->cache_dir;
+    code_load(mem);
+    mem->session = session;
+    session->mem = mem;
+    session->live_next = *live;
+    if (*live != NULL)
+      (*live)->live_prev = session;
+    *live = session;
+    return session;
+}
+
+ /*
+ *  session_free (Private Helper Function)
+ *
+ *  Function: Closes the connection, takes the session off the live
+ *  sessions and frees it, and its UM if it has not halted. Closing the
+ *  fd also removes it from epoll.
+ *  Input: struct um_session **live, struct um_session *session
+ *  Output: None
+ *  Expectations: the session must not be in a run queue still in use.
+ */
+static void session_free(struct um_session **live,
+                         struct um_session *session)
+{
+    if (session->live_prev != NULL)
+      session->live_prev->live_next = session->live_next;
+    else
+      *live = session->live_next;
+    if (session->live_next != NULL)
+      session->live_next->live_prev = session->live_prev;
+    if (session->mem != NULL)
+      free_memory(session->mem);
+    close(session->fd);
+    free(session->in.data);
+    free(session->out.data);
+    free(session);
+}
+
+ /*
+ *  run_quantum (Private Helper Function)
+ *
+ *  Function: Runs the session's UM until it halts, blocks on input, or
+ *  reaches a load_program after at least QUANTUM instructions. It also
+ *  stops at a block boundary once too much output is queued.
+ *  Input: struct um_session *session, int dedup
+ *  Output: None, session->state tells why the UM stopped.
+ *  Expectations: the session must be runnable.
+ */
+static void run_quantum(struct um_session *session, int dedup)
+{
+    um_memory mem = session->mem;
+    uint32_t executed = 0;
+    for (;;) {
+      uint32_t opcode = get_next_instruction(mem);
+      if (opcode == HALT_OP) {
+        session->mem = NULL;
+        session->state = HALTED;
+        return ;
+      }
+      if (opcode == INPUT_BLOCKED) {
+        session->state = WAIT_INPUT;
+        break;
+      }
+      executed++;
+      if (opcode != LOAD_PROGRAM_OP)
+        continue;
+      if (session->out.length >= QUEUE_LIMIT) {
+        session->state = WAIT_OUTPUT;
+        break;
+      }
+      if (executed >= QUANTUM)
+        break;
+    }
+    uint64_t before = session->executed;
+    session->executed += executed;
+    if (dedup && before / DEDUP_INTERVAL != session->executed / DEDUP_INTERVAL)
+      dedup_scan(mem);
+}
+
+ /*
+ *  read_input (Private Helper Function)
+ *
+ *  Function: Reads what the connection has to offer into the input
+ *  queue, up to QUEUE_LIMIT bytes. End of file or an error ends input.
+ *  Input: struct um_session *session
+ *  Output: None
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static void read_input(struct um_session *session)
+{
+    unsigned char buf[4096];
+    while (!session->input_eof && session->in.length < QUEUE_LIMIT) {
+      ssize_t n = recv(session->fd, buf, sizeof(buf), 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return ;
+      if (n <= 0) {
+        session->input_eof = 1;
+        return ;
+      }
+      queue_push(&session->in, buf, n);
+    }
+}
+
+ /*
+ *  flush_output (Private Helper Function)
+ *
+ *  Function: Sends as much queued output as the connection takes without
+ *  blocking. A send error means the client is gone: the output is dropped
+ *  and the session is marked closed.
+ *  Input: struct um_session *session
+ *  Output: None
+ *  Expectations: none
+ */
+static void flush_output(struct um_session *session)
+{
+    struct byte_queue *out = &session->out;
+    while (out->length > 0) {
+      ssize_t n = send(session->fd, out->data + out->head, out->length,
+                       MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return ;
+      if (n < 0) {
+        session->closed = 1;
+        out->length = 0;
+        return ;
+      }
+      out->head += n;
+      out->length -= n;
+    }
+}
+
+ /*
+ *  update_events (Private Helper Function)
+ *
+ *  Function: Registers the connection for the events the session waits
+ *  for: readable while input is wanted and the input queue has room,
+ *  writable while output is queued.
+ *  Input: int epoll_fd, struct um_session *session
+ *  Output: None
+ *  Expectations: Will raise CRE if epoll_ctl fails.
+ */
+static void update_events(int epoll_fd, struct um_session *session)
+{
+    uint32_t events = 0;
+    if (!session->input_eof && session->in.length < QUEUE_LIMIT
+        && session->state != HALTED)
+      events |= EPOLLIN;
+    if (session->out.length > 0)
+      events |= EPOLLOUT;
+    if (session->registered && events == session->events)
+      return ;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = session;
+    int op = session->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    int rc = epoll_ctl(epoll_fd, op, session->fd, &ev);
+    assert(rc == 0);
+    session->registered = 1;
+    session->events = events;
+}
+
+static void enqueue(struct run_queue *queue, struct um_session *session)
+{
+    session->next = NULL;
+    if (queue->last != NULL)
+      queue->last->next = session;
+    else
+      queue->first = session;
+    queue->last = session;
+}
+
+static struct um_session *dequeue(struct run_queue *queue)
+{
+    struct um_session *session = queue->first;
+    queue->first = session->next;
+    if (queue->first == NULL)
+      queue->last = NULL;
+    return session;
+}
+
+ /*
+ *  queue_push (Private Helper Function)
+ *
+ *  Function: Appends bytes to a byte queue, first moving the unread
+ *  bytes to the front and then growing the buffer if needed
+ *  Input: struct byte_queue *queue, const unsigned char *bytes,
+ *  size_t length
+ *  Output: None
+ *  Expectations: Will raise CRE if allocating memory is unsuccessful.
+ */
+static void queue_push(struct byte_queue *queue, const unsigned char *bytes,
+                       size_t length)
+{
+    if (queue->head != 0
+        && queue->head + queue->length + length > queue->capacity) {
+      memmove(queue->data, queue->data + queue->head, queue->length);
+      queue->head = 0;
+    }
+    if (queue->length + length > queue->capacity) {
+      size_t capacity = queue->capacity ? queue->capacity : 256;
+      while (capacity < queue->length + length)
+        capacity *= 2;
+      queue->data = realloc(queue->data, capacity);
+      assert(queue->data);
+      queue->capacity = capacity;
+    }
+    memcpy(queue->data + queue->head + queue->length, bytes, length);
+    queue->length += length;
+}
+
+ /*
+ *  listen_on (Private Helper Function)
+ *
+ *  Function: Opens a non-blocking TCP socket listening on port
+ *  Input: int port
+ *  Output: the listening fd
+ *  Expectations: Will raise CRE if the port cannot be listened on.
+ */
+static int listen_on(int port)
+{
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    assert(fd >= 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    assert(rc == 0);
+    rc = listen(fd, SOMAXCONN);
+    assert(rc == 0);
+    return fd;
+}
+
+ /*
+ *  set_accepting (Private Helper Function)
+ *
+ *  Function: Adds the listening socket to epoll, or removes it so that
+ *  pending connections stop waking epoll_wait.
+ *  Input: int epoll_fd, int listen_fd, int on (non-zero adds it)
+ *  Output: None
+ *  Expectations: Will raise CRE if epoll_ctl is unsuccessful.
+ */
+static void set_accepting(int epoll_fd, int listen_fd, int on)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    int rc = epoll_ctl(epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                       listen_fd, &ev);
+    assert(rc == 0);
+}
+
+ /*
+ *  now_ms (Private Helper Function)
+ *
+ *  Function: Reads the monotonic clock
+ *  Input: None
+ *  Output: the time in milliseconds
+ *  Expectations: none
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+static void on_stop(int signo)
+{
+    (void)signo;
+    stop_requested = 1;
+}
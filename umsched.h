@@ -0,0 +1,35 @@
+/**************************************************************
+*     Assignment: um
+*     Authors: Isaac Hudis, Erena Inoue
+*     Date: 10/19/26
+*     File: umsched.h
+*     Summary: Interface of umsched module, which time-slices many
+*     UMs, one per connection, on a single thread
+**************************************************************/
+
+#ifndef UMSCHED_INCLUDED
+#define UMSCHED_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include "segmem.h"
+
+/* instructions a UM may run before it yields at a block boundary */
+#define QUANTUM 100000
+
+struct um_session;
+
+/* runs one copy of the image for every connection to port, until
+   SIGINT or SIGTERM */
+void sched_serve(um_memory image, int port, int dedup);
+
+/* 1 if the session's UM can execute input without waiting */
+int session_input_ready(struct um_session *session);
+
+/* next input byte of the session, or all ones once input has ended */
+uint32_t session_getc(struct um_session *session);
+
+/* queues one output byte of the session */
+void session_putc(struct um_session *session, uint32_t byte);
+
+#endif